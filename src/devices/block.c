@@ -3,7 +3,18 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* A request that has waited this many timer ticks is served ahead
+   of the elevator order.  A thread is usually waiting on a read,
+   whereas most writes are write-behind, so reads expire sooner. */
+#define READ_EXPIRE (TIMER_FREQ / 10)
+#define WRITE_EXPIRE TIMER_FREQ
+
+/* Most buffers in one request merged from several. */
+#define MERGE_IOV_MAX 64
 
 /* A block device. */
 struct block
@@ -16,9 +27,21 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    int channel;                        /* Controller channel. */
+
+    struct list queue;                  /* Submitted requests, sorted by
+                                           sector. */
+    struct lock queue_lock;             /* Protects QUEUE, NEXT_SEQ and
+                                           the statistics. */
+    struct condition queue_ready;       /* Signaled when QUEUE is nonempty. */
+    unsigned long long next_seq;        /* Next request's sequence number. */
+    block_sector_t head;                /* Sector after the last request
+                                           served.  Driver thread only. */
+    struct block_iovec merge_iov[MERGE_IOV_MAX]; /* Buffers of a merged
+                                           request.  Driver thread only. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    struct block_stats stats;           /* Statistics. */
+    int64_t depth_changed;              /* When STATS.depth last changed. */
   };
 
 /* List of all block devices. */
@@ -28,6 +51,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static list_less_func request_less;
+static int64_t usecs_between (int64_t then, int64_t now);
+static int stats_bucket (uint64_t);
+static void change_depth (struct block *, int delta, int64_t now);
+static thread_func block_thread NO_RETURN;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +148,8 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_iovec iov = { buffer, 1 };
+  block_read_multi (block, sector, &iov, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +160,340 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  struct block_iovec iov = { (void *) buffer, 1 };
+  block_write_multi (block, sector, &iov, 1);
+}
+
+/* Returns the number of sectors in the IOV_CNT buffers of IOV. */
+static block_sector_t
+iov_sectors (const struct block_iovec *iov, size_t iov_cnt)
+{
+  block_sector_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    cnt += iov[i].cnt;
+  return cnt;
+}
+
+/* Reads consecutive sectors from BLOCK, starting at SECTOR, into
+   the IOV_CNT buffers of IOV, filling each buffer in turn.  One
+   request to the driver covers all of them if it supports that.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector,
+                  const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  block_request_init (&r, false, sector, iov, iov_cnt, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes consecutive sectors to BLOCK, starting at SECTOR, from
+   the IOV_CNT buffers of IOV, like block_read_multi.  Returns
+   after the block device has acknowledged receiving the data. */
+void
+block_write_multi (struct block *block, block_sector_t sector,
+                   const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  block_request_init (&r, true, sector, iov, iov_cnt, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Initializes R as a request to read or write, according to WRITE,
+   the sectors starting at SECTOR to or from the IOV_CNT buffers of
+   IOV.  If CALLBACK is non-null, it is called with R and AUX on
+   completion, otherwise completion is waited for with
+   block_wait. */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector,
+                    const struct block_iovec *iov, size_t iov_cnt,
+                    block_callback_func *callback, void *aux)
+{
+  r->write = write;
+  r->sector = sector;
+  r->iov = iov;
+  r->iov_cnt = iov_cnt;
+  r->callback = callback;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+}
+
+/* Queues request R on BLOCK and returns without waiting for it.
+   Panics if R reaches past the end of BLOCK. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  block_sector_t cnt = iov_sectors (r->iov, r->iov_cnt);
+
+  if (cnt > 0)
+    {
+      check_sector (block, r->sector);
+      check_sector (block, r->sector + cnt - 1);
+    }
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  r->sector_cnt = cnt;
+  r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+  r->submitted = timer_usecs ();
+
+  lock_acquire (&block->queue_lock);
+  r->seq = block->next_seq++;
+  if (r->write)
+    block->stats.write_requests++;
+  else
+    block->stats.read_requests++;
+  block->stats.size_hist[stats_bucket (cnt)]++;
+  change_depth (block, 1, r->submitted);
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which has no callback, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->callback == NULL);
+  sema_down (&r->done);
+}
+
+/* Returns true if request A's first sector precedes request
+   B's. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Returns true if requests A and B have a sector in common and at
+   least one of them writes it, so that they must be carried out in
+   the order submitted. */
+static bool
+conflicts (const struct block_request *a, const struct block_request *b)
+{
+  return ((a->write || b->write)
+          && a->sector < b->sector + b->sector_cnt
+          && b->sector < a->sector + a->sector_cnt);
+}
+
+/* Returns the request in BLOCK's queue that must be carried out
+   before R, or R itself if there is none. */
+static struct block_request *
+first_conflict (struct block *block, struct block_request *r)
+{
+  for (;;)
+    {
+      struct block_request *older = NULL;
+      struct list_elem *e;
+
+      for (e = list_begin (&block->queue); e != list_end (&block->queue);
+           e = list_next (e))
+        {
+          struct block_request *o = list_entry (e, struct block_request, elem);
+          if (o->seq < r->seq && conflicts (o, r)
+              && (older == NULL || o->seq < older->seq))
+            older = o;
+        }
+      if (older == NULL)
+        return r;
+      r = older;
+    }
+}
+
+/* Chooses the next request to carry out from BLOCK's nonempty
+   queue: the expired read or, failing that, the expired write with
+   the earliest deadline, or otherwise the first request at or past
+   the head, wrapping around to the lowest sector (C-LOOK). */
+static struct block_request *
+schedule (struct block *block)
+{
+  struct block_request *expired[2] = { NULL, NULL };
+  struct block_request *next = NULL;
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      struct block_request **x = &expired[r->write];
+
+      if (r->deadline <= now && (*x == NULL || r->deadline < (*x)->deadline))
+        *x = r;
+      if (next == NULL && r->sector >= block->head)
+        next = r;
+    }
+
+  if (expired[false] != NULL)
+    next = expired[false];
+  else if (expired[true] != NULL)
+    next = expired[true];
+  else if (next == NULL)
+    next = list_entry (list_front (&block->queue), struct block_request, elem);
+  return first_conflict (block, next);
+}
+
+/* Removes the next request from BLOCK's nonempty queue into BATCH,
+   followed by any queued requests in the same direction that
+   continue it on disk and may be carried out now, up to
+   MERGE_IOV_MAX buffers in all.  Returns the first request. */
+static struct block_request *
+take_batch (struct block *block, struct list *batch)
+{
+  struct block_request *r = schedule (block);
+  block_sector_t end = r->sector + r->sector_cnt;
+  size_t iov_cnt = r->iov_cnt;
+  struct list_elem *e = list_next (&r->elem);
+  int64_t now = timer_usecs ();
+  block_sector_t seek = (r->sector > block->head ? r->sector - block->head
+                         : block->head - r->sector);
+
+  block->stats.dispatches++;
+  block->stats.seek_total += seek;
+  block->stats.seek_hist[stats_bucket (seek)]++;
+  block->stats.wait_time += usecs_between (r->submitted, now);
+
+  list_remove (&r->elem);
+  list_push_back (batch, &r->elem);
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *n = list_entry (e, struct block_request, elem);
+
+      if (n->sector != end || n->write != r->write
+          || iov_cnt + n->iov_cnt > MERGE_IOV_MAX
+          || first_conflict (block, n) != n)
+        break;
+      e = list_remove (e);
+      list_push_back (batch, &n->elem);
+      block->stats.wait_time += usecs_between (n->submitted, now);
+      end += n->sector_cnt;
+      iov_cnt += n->iov_cnt;
+    }
+  block->head = end;
+  return r;
+}
+
+/* Transfers the sectors of BLOCK starting at SECTOR to or from the
+   IOV_CNT buffers of IOV, according to WRITE, with the driver's
+   operations. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t i, j;
+
+  if (write)
+    {
+      if (block->ops->write_multi != NULL)
+        block->ops->write_multi (block->aux, sector, iov, iov_cnt);
+      else
+        for (i = 0; i < iov_cnt; i++)
+          for (j = 0; j < iov[i].cnt; j++)
+            block->ops->write (block->aux, sector++,
+                               ((const uint8_t *) iov[i].buffer
+                                + j * BLOCK_SECTOR_SIZE));
+    }
+  else
+    {
+      if (block->ops->read_multi != NULL)
+        block->ops->read_multi (block->aux, sector, iov, iov_cnt);
+      else
+        for (i = 0; i < iov_cnt; i++)
+          for (j = 0; j < iov[i].cnt; j++)
+            block->ops->read (block->aux, sector++,
+                              ((uint8_t *) iov[i].buffer
+                               + j * BLOCK_SECTOR_SIZE));
+    }
+}
+
+/* Driver thread of BLOCK: carries out the requests in its queue,
+   merging those it can, and reports their completion. */
+static void
+block_thread (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct block_request *r;
+      struct list batch;
+      struct list_elem *e;
+      int64_t start, end;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      r = take_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      start = timer_usecs ();
+      if (list_size (&batch) == 1)
+        {
+          if (r->iov_cnt > 0)
+            transfer (block, r->write, r->sector, r->iov, r->iov_cnt);
+        }
+      else
+        {
+          size_t iov_cnt = 0;
+
+          for (e = list_begin (&batch); e != list_end (&batch);
+               e = list_next (e))
+            {
+              struct block_request *m
+                = list_entry (e, struct block_request, elem);
+              memcpy (block->merge_iov + iov_cnt, m->iov,
+                      m->iov_cnt * sizeof *m->iov);
+              iov_cnt += m->iov_cnt;
+            }
+          if (iov_cnt > 0)
+            transfer (block, r->write, r->sector, block->merge_iov, iov_cnt);
+        }
+      end = timer_usecs ();
+
+      lock_acquire (&block->queue_lock);
+      block->stats.service_time += usecs_between (start, end);
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          struct block_request *m = list_entry (e, struct block_request, elem);
+          int64_t latency = usecs_between (m->submitted, end);
+
+          if (m->write)
+            {
+              block->stats.write_cnt += m->sector_cnt;
+              block->stats.write_latency[stats_bucket (latency)]++;
+            }
+          else
+            {
+              block->stats.read_cnt += m->sector_cnt;
+              block->stats.read_latency[stats_bucket (latency)]++;
+            }
+          change_depth (block, -1, end);
+        }
+      lock_release (&block->queue_lock);
+
+      /* A completed request may be freed or reused at once, so
+         remove it from BATCH first. */
+      while (!list_empty (&batch))
+        {
+          r = list_entry (list_pop_front (&batch), struct block_request, elem);
+          if (r->callback != NULL)
+            r->callback (r, r->aux);
+          else
+            sema_up (&r->done);
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,7 +517,109 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns the controller channel that BLOCK is attached to, or
+   BLOCK_NO_CHANNEL. */
+int
+block_channel (struct block *block)
+{
+  return block->channel;
+}
+
+/* Records that BLOCK is attached to controller CHANNEL, a number
+   chosen by its driver, or to none if CHANNEL is
+   BLOCK_NO_CHANNEL. */
+void
+block_set_channel (struct block *block, int channel)
+{
+  block->channel = channel;
+}
+
+/* Returns the time from THEN to NOW in microseconds, or 0 if the
+   clock seems to have gone back. */
+static int64_t
+usecs_between (int64_t then, int64_t now)
+{
+  return now > then ? now - then : 0;
+}
+
+/* Returns the histogram bucket that counts VALUE, as described in
+   <block-stats.h>. */
+static int
+stats_bucket (uint64_t value)
+{
+  int bucket = 0;
+
+  while (value > 0 && bucket < BLOCK_STATS_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Changes BLOCK's queue depth by DELTA at time NOW, first adding
+   the old depth for the time since it last changed to the
+   statistics.  BLOCK's queue_lock must be held, if locks may be
+   used at all. */
+static void
+change_depth (struct block *block, int delta, int64_t now)
+{
+  struct block_stats *s = &block->stats;
+
+  s->depth_time += s->depth * usecs_between (block->depth_changed, now);
+  block->depth_changed = now;
+  s->depth += delta;
+  if (s->depth > s->max_depth)
+    s->max_depth = s->depth;
+}
+
+/* Copies BLOCK's statistics into STATS, without locking. */
+static void
+take_stats (struct block *block, struct block_stats *stats)
+{
+  int64_t now = timer_usecs ();
+
+  change_depth (block, 0, now);
+  *stats = block->stats;
+  stats->time = now;
+}
+
+/* Copies BLOCK's statistics as of now into STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  lock_acquire (&block->queue_lock);
+  take_stats (block, stats);
+  lock_release (&block->queue_lock);
+}
+
+/* Prints the nonzero buckets of histogram HIST, titled TITLE. */
+static void
+print_hist (const char *title, const uint64_t hist[BLOCK_STATS_BUCKETS])
+{
+  int i;
+
+  printf ("  %s:", title);
+  for (i = 0; i < BLOCK_STATS_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        uint64_t low = i > 0 ? 1ULL << (i - 1) : 0;
+        uint64_t high = i > 0 ? (1ULL << i) - 1 : 0;
+
+        if (i == BLOCK_STATS_BUCKETS - 1)
+          printf (" %"PRIu64"+", low);
+        else if (low == high)
+          printf (" %"PRIu64, low);
+        else
+          printf (" %"PRIu64"-%"PRIu64, low, high);
+        printf (":%"PRIu64, hist[i]);
+      }
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos role.
+   The queue locks are not taken, since this may be called while
+   the kernel panics. */
 void
 block_print_stats (void)
 {
@@ -171,9 +630,26 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          struct block_stats s;
+          uint64_t depth;
+
+          take_stats (block, &s);
+          depth = s.time > 0 ? s.depth_time * 100 / s.time : 0;
+          printf ("%s (%s): %"PRIu64" reads, %"PRIu64" writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  s.read_cnt, s.write_cnt);
+          printf ("  %"PRIu64" read and %"PRIu64" write requests in "
+                  "%"PRIu64" dispatches, queue depth %"PRIu64".%02"PRIu64
+                  " average, %"PRIu32" max\n",
+                  s.read_requests, s.write_requests, s.dispatches,
+                  depth / 100, depth % 100, s.max_depth);
+          printf ("  %"PRIu64" us queued, %"PRIu64" us in service, "
+                  "%"PRIu64" sectors seeked\n",
+                  s.wait_time, s.service_time, s.seek_total);
+          print_hist ("request sectors", s.size_hist);
+          print_hist ("read latency (us)", s.read_latency);
+          print_hist ("write latency (us)", s.write_latency);
+          print_hist ("seek sectors", s.seek_hist);
         }
     }
 }
@@ -198,8 +674,17 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  block->channel = BLOCK_NO_CHANNEL;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->depth_changed = 0;
+  list_init (&block->queue);
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_ready);
+  block->next_seq = 0;
+  block->head = 0;
+  if (thread_create (block->name, PRI_DEFAULT, block_thread, block)
+      == TID_ERROR)
+    PANIC ("Failed to start driver thread for block device %s", name);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <block-stats.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -49,22 +52,91 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* One buffer of a multi-sector request, holding CNT consecutive
+   sectors of the request. */
+struct block_iovec
+  {
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    size_t cnt;                 /* Number of sectors. */
+  };
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t,
+                       const struct block_iovec *, size_t iov_cnt);
+void block_write_multi (struct block *, block_sector_t,
+                        const struct block_iovec *, size_t iov_cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Controller channels.  Devices on different channels can carry
+   out requests at the same time, while devices that share a
+   channel take turns. */
+#define BLOCK_NO_CHANNEL -1     /* Shares a channel with nothing. */
+int block_channel (struct block *);
+void block_set_channel (struct block *, int channel);
+
+/* Asynchronous requests.
+
+   A request is queued on its device by block_submit, which returns
+   at once, and carried out by the device's driver thread.  The
+   driver thread sweeps across the disk in ascending sector order,
+   merging requests to consecutive sectors, but never lets a request
+   overtake an earlier one that touches the same sectors unless both
+   only read them.  On completion the driver thread calls the
+   request's callback, if it has one, or else ups the request's
+   semaphore, which block_wait downs.  A callback runs in the
+   driver thread, so it must not wait for another request to the
+   same device.  The request and its buffers belong to the driver
+   until it completes. */
+struct block_request;
+typedef void block_callback_func (struct block_request *, void *aux);
+
+struct block_request
+  {
+    struct list_elem elem;              /* In the device's queue. */
+    bool write;                         /* Write, or read? */
+    block_sector_t sector;              /* First sector. */
+    const struct block_iovec *iov;      /* Buffers. */
+    size_t iov_cnt;                     /* Number of buffers. */
+    block_callback_func *callback;      /* Called on completion, or null. */
+    void *aux;                          /* Passed to CALLBACK. */
+    struct semaphore done;              /* Upped on completion if no
+                                           CALLBACK. */
+
+    /* Set by block_submit for the scheduler. */
+    block_sector_t sector_cnt;          /* Number of sectors. */
+    int64_t deadline;                   /* Serve ahead of order after. */
+    int64_t submitted;                  /* Time submitted, in us. */
+    unsigned long long seq;             /* Order of submission. */
+  };
+
+void block_request_init (struct block_request *, bool write, block_sector_t,
+                         const struct block_iovec *, size_t iov_cnt,
+                         block_callback_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* READ_MULTI and WRITE_MULTI transfer the sectors starting at the
+   given one to or from the buffers of an I/O vector.  A driver may
+   leave them null, and then each sector is transferred with READ
+   or WRITE. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multi) (void *aux, block_sector_t,
+                        const struct block_iovec *, size_t iov_cnt);
+    void (*write_multi) (void *aux, block_sector_t,
+                         const struct block_iovec *, size_t iov_cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,22 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  ERR and INTR are cleared by
+   writing 1 to them. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk interrupted. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +68,41 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors transferred by one command.  A sector count of 0 in
+   the command block means 256. */
+#define MAX_COMMAND_SECTORS 256
+
+/* PCI configuration space access, configuration mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8           /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Selected register. */
+#define PCI_REG_ID 0x00                 /* Vendor and device ID. */
+#define PCI_REG_COMMAND 0x04            /* Command. */
+#define PCI_REG_CLASS 0x08              /* Class, subclass, prog. i/f. */
+#define PCI_REG_BAR4 0x20               /* Base address 4. */
+#define PCI_CMD_IO 0x0001               /* Respond to I/O space. */
+#define PCI_CMD_MASTER 0x0004           /* Enable bus mastering. */
+
+/* A physical region descriptor, one entry in the table that tells
+   the bus master where to transfer data.  A region may not cross a
+   64 kB boundary, and a size of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Entries in a channel's PRD table, which fills a page.  One command
+   needs at most two per sector, if every sector's buffer straddles a
+   64 kB boundary. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +111,14 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ and
+                                   WRITE MULTIPLE, 0 if unsupported. */
+    bool dma;                   /* Transfer by bus-master DMA? */
+
+    /* Statistics, protected by the channel's lock. */
+    unsigned long long cmd_cnt; /* Commands issued. */
+    int64_t busy_ticks;         /* Time holding the channel. */
+    int64_t wait_ticks;         /* Time waiting for the other disk. */
   };
 
 /* An ATA channel (aka controller).
@@ -66,6 +128,8 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+    struct prd *prdt;           /* PRD table, if BM_BASE is nonzero. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
@@ -81,12 +145,19 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max);
+static void select_sectors (struct ata_disk *, block_sector_t,
+                            block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
+struct iov_cursor;
+static void dma_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, struct iov_cursor *,
+                          bool write);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -101,6 +172,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,6 +195,14 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
@@ -136,6 +216,11 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->cmd_cnt = 0;
+          d->busy_ticks = 0;
+          d->wait_ticks = 0;
         }
 
       /* Register interrupt handler. */
@@ -155,10 +240,105 @@ ide_init (void)
     }
 }
 
+/* Prints statistics for each disk and how busy each channel has
+   been since boot.  Disks on different channels carry out commands
+   at the same time, while those on one channel take turns. */
+void
+ide_print_stats (void)
+{
+  int64_t ticks = timer_ticks ();
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int64_t busy_ticks = 0;
+      bool any = false;
+      int dev_no;
+
+      for (dev_no = 0; dev_no < 2; dev_no++)
+        {
+          struct ata_disk *d = &c->devices[dev_no];
+          if (d->is_ata)
+            {
+              printf ("%s: %llu commands, busy %"PRId64" ticks, "
+                      "waited %"PRId64" ticks for %s\n",
+                      d->name, d->cmd_cnt, d->busy_ticks, d->wait_ticks,
+                      c->name);
+              busy_ticks += d->busy_ticks;
+              any = true;
+            }
+        }
+      if (any && ticks > 0)
+        printf ("%s: busy %"PRId64" of %"PRId64" ticks (%"PRId64"%%)\n",
+                c->name, busy_ticks, ticks, busy_ticks * 100 / ticks);
+    }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Reads the 32-bit PCI configuration register at offset REG of
+   function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to a PCI configuration register, like
+   pci_read_config. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus-master
+   DMA, such as the PIIX emulated by QEMU, and enables it as a bus
+   master.  Returns the I/O port of its primary channel's bus master
+   registers, those of the secondary channel following 8 ports
+   later, or 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4;
+
+        if ((pci_read_config (0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          {
+            if (func == 0)
+              break;
+            continue;
+          }
+
+        /* Mass storage, IDE, with bus mastering (prog. i/f bit 7). */
+        class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+        if ((class >> 16) != 0x0101 || !(class & 0x8000))
+          continue;
+
+        /* Base address 4 must be in I/O space. */
+        bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+        if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+          continue;
+
+        pci_write_config (0, dev, func, PCI_REG_COMMAND,
+                          (pci_read_config (0, dev, func, PCI_REG_COMMAND)
+                           | PCI_CMD_IO | PCI_CMD_MASTER));
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -303,9 +483,17 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer as many sectors per interrupt as the disk allows,
+     or by DMA if both the disk and the controller support it. */
+  set_multiple_mode (d, id[47 * 2] & 0xff);
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_set_channel (block, c - channels);
   partition_scan (block);
 }
 
@@ -337,23 +525,205 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Enables READ MULTIPLE and WRITE MULTIPLE on disk D with blocks
+   of MAX sectors, the most the disk supports according to IDENTIFY
+   DEVICE, so that a transfer takes one interrupt per block rather
+   than per sector.  Leaves them disabled if MAX is 0 or the disk
+   rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, int max)
+{
+  struct channel *c = d->channel;
+
+  d->multiple = 0;
+  if (max == 0)
+    return;
+  select_device_wait (d);
+  outb (reg_nsect (c), max);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_alt_status (c)) & STA_ERR))
+    d->multiple = max;
+}
+
+/* Position in an I/O vector, advanced a sector at a time. */
+struct iov_cursor
+  {
+    const struct block_iovec *iov;      /* Current buffer. */
+    size_t ofs;                         /* Sectors of it done. */
+  };
+
+/* Returns the number of sectors in the IOV_CNT buffers of IOV. */
+static block_sector_t
+iov_sectors (const struct block_iovec *iov, size_t iov_cnt)
+{
+  block_sector_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    cnt += iov[i].cnt;
+  return cnt;
+}
+
+/* Returns the buffer for the next sector at cursor P and advances
+   P past it. */
+static uint8_t *
+next_sector (struct iov_cursor *p)
+{
+  while (p->ofs == p->iov->cnt)
+    {
+      p->iov++;
+      p->ofs = 0;
+    }
+  return (uint8_t *) p->iov->buffer + p->ofs++ * BLOCK_SECTOR_SIZE;
+}
+
+/* Acquires the channel of disk D, which the disk shares with the
+   other one on the channel, and returns the time it did so. */
+static int64_t
+channel_acquire (struct ata_disk *d)
+{
+  int64_t start = timer_ticks ();
+
+  lock_acquire (&d->channel->lock);
+  d->wait_ticks += timer_elapsed (start);
+  return timer_ticks ();
+}
+
+/* Releases the channel of disk D, acquired at time START. */
+static void
+channel_release (struct ata_disk *d, int64_t start)
+{
+  d->busy_ticks += timer_elapsed (start);
+  lock_release (&d->channel->lock);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into the
+   buffers at P by PIO.  With READ MULTIPLE the disk interrupts
+   once per block of D->multiple sectors, otherwise once per
+   sector. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+          struct iov_cursor *p)
+{
+  struct channel *c = d->channel;
+  block_sector_t block = d->multiple > 0 ? d->multiple : 1;
+  block_sector_t done = 0;
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple > 0 ? CMD_READ_MULTIPLE
+                         : CMD_READ_SECTOR_RETRY));
+  while (done < cnt)
+    {
+      block_sector_t n = cnt - done < block ? cnt - done : block;
+
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (done += n; n > 0; n--)
+        input_sector (c, next_sector (p));
+    }
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from the
+   buffers at P by PIO, like pio_read. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+           struct iov_cursor *p)
+{
+  struct channel *c = d->channel;
+  block_sector_t block = d->multiple > 0 ? d->multiple : 1;
+  block_sector_t done = 0;
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                         : CMD_WRITE_SECTOR_RETRY));
+  while (done < cnt)
+    {
+      block_sector_t n = cnt - done < block ? cnt - done : block;
+
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (done += n; n > 0; n--)
+        output_sector (c, next_sector (p));
+      sema_down (&c->completion_wait);
+    }
+}
+
+/* Reads the sectors starting at SEC_NO from disk D into the
+   IOV_CNT buffers of IOV, with one command per MAX_COMMAND_SECTORS
+   sectors, by DMA if D supports it and otherwise by PIO.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no,
+                const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct ata_disk *d = d_;
+  struct iov_cursor p = { iov, 0 };
+  block_sector_t left = iov_sectors (iov, iov_cnt);
+  int64_t start;
+
+  start = channel_acquire (d);
+  while (left > 0)
+    {
+      block_sector_t cnt = left < MAX_COMMAND_SECTORS ? left
+                                                      : MAX_COMMAND_SECTORS;
+
+      if (d->dma)
+        dma_transfer (d, sec_no, cnt, &p, false);
+      else
+        pio_read (d, sec_no, cnt, &p);
+      d->cmd_cnt++;
+      sec_no += cnt;
+      left -= cnt;
+    }
+  channel_release (d, start);
+}
+
+/* Writes the sectors starting at SEC_NO to disk D from the IOV_CNT
+   buffers of IOV, like ide_read_multi.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no,
+                 const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct ata_disk *d = d_;
+  struct iov_cursor p = { iov, 0 };
+  block_sector_t left = iov_sectors (iov, iov_cnt);
+  int64_t start;
+
+  start = channel_acquire (d);
+  while (left > 0)
+    {
+      block_sector_t cnt = left < MAX_COMMAND_SECTORS ? left
+                                                      : MAX_COMMAND_SECTORS;
+
+      if (d->dma)
+        dma_transfer (d, sec_no, cnt, &p, true);
+      else
+        pio_write (d, sec_no, cnt, &p);
+      d->cmd_cnt++;
+      sec_no += cnt;
+      left -= cnt;
+    }
+  channel_release (d, start);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read (void *d, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_iovec iov = { buffer, 1 };
+  ide_read_multi (d, sec_no, &iov, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -362,38 +732,35 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_iovec iov = { (void *) buffer, 1 };
+  ide_write_multi (d, sec_no, &iov, 1);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, at most MAX_COMMAND_SECTORS, to the
+   disk's sector selection and count registers.  (We use LBA
+   mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no,
+                block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_COMMAND_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,6 +781,81 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
+/* Fills channel C's PRD table with the physical regions of the
+   buffers for the next CNT sectors at P, and advances P past them.
+   Kernel virtual memory maps physical memory contiguously, so
+   regions that follow each other in virtual memory are merged,
+   except across 64 kB boundaries. */
+static void
+build_prdt (struct channel *c, struct iov_cursor *p, block_sector_t cnt)
+{
+  struct prd *prdt = c->prdt;
+  size_t n = 0;
+  uint32_t end = 0;
+
+  for (; cnt > 0; cnt--)
+    {
+      uint32_t addr = vtop (next_sector (p));
+      uint32_t size = BLOCK_SECTOR_SIZE;
+
+      while (size > 0)
+        {
+          uint32_t chunk = 0x10000 - (addr & 0xffff);
+          if (chunk > size)
+            chunk = size;
+
+          /* A size that reaches 64 kB wraps around to 0, as it
+             should. */
+          if (n > 0 && addr == end && (addr & 0xffff) != 0)
+            prdt[n - 1].size += chunk;
+          else
+            {
+              ASSERT (n < PRD_CNT);
+              prdt[n].addr = addr;
+              prdt[n].size = chunk;
+              prdt[n].flags = 0;
+              n++;
+            }
+          addr += chunk;
+          end = addr;
+          size -= chunk;
+        }
+    }
+  prdt[n - 1].flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO, at most
+   MAX_COMMAND_SECTORS, between disk D and the buffers at P by
+   bus-master DMA, writing to the disk if WRITE is true and reading
+   from it otherwise.  The CPU is free for other threads until the
+   disk interrupts at the end of the transfer. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              struct iov_cursor *p, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t status;
+
+  build_prdt (c, p, cnt);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), direction);
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), status | BM_STA_ERR | BM_STA_INTR);
+  if ((status & BM_STA_ERR) != 0 || (inb (reg_alt_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void
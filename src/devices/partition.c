@@ -181,7 +181,9 @@ found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      block_set_channel (block_register (name, type, extra_info, size,
+                                         &partition_operations, p),
+                         block_channel (block));
     }
 }
 
@@ -317,8 +319,32 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads the sectors starting at SECTOR from partition P into the
+   IOV_CNT buffers of IOV, as one request to the underlying
+   device. */
+static void
+partition_read_multi (void *p_, block_sector_t sector,
+                      const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct partition *p = p_;
+  block_read_multi (p->block, p->start + sector, iov, iov_cnt);
+}
+
+/* Writes the sectors starting at SECTOR to partition P from the
+   IOV_CNT buffers of IOV, as one request to the underlying
+   device. */
+static void
+partition_write_multi (void *p_, block_sector_t sector,
+                       const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct partition *p = p_;
+  block_write_multi (p->block, p->start + sector, iov, iov_cnt);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multi,
+    partition_write_multi
   };
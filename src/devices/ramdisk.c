@@ -0,0 +1,87 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in memory, whose contents are lost at
+   shutdown.  It transfers without doing any I/O, so it serves for
+   scratch data and as a baseline for measuring the file system and
+   VM code paths apart from the disk. */
+
+/* Sectors held by one page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Pages holding the sectors, in order. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk named "ram0" of KB kilobytes, rounded up to a
+   whole page and zeroed, and registers it as a raw block device,
+   so that it can be given a role with -filesys, -scratch or -swap.
+   Panics if there is not enough kernel memory. */
+void
+ramdisk_init (size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  struct ramdisk *rd;
+  char extra_info[32];
+  size_t i;
+
+  ASSERT (page_cnt > 0);
+
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+  rd->pages = malloc (page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("Failed to allocate memory for RAM disk page table");
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("Not enough kernel memory for a %zu kB RAM disk", kb);
+    }
+
+  snprintf (extra_info, sizeof extra_info, "%zu pages of memory", page_cnt);
+  block_register ("ram0", BLOCK_RAW, extra_info, page_cnt * SECTORS_PER_PAGE,
+                  &ramdisk_operations, rd);
+}
+
+/* Returns the memory that holds SECTOR of RD. */
+static uint8_t *
+sector_data (struct ramdisk *rd, block_sector_t sector)
+{
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR of RAM disk RD into BUFFER. */
+static void
+ramdisk_read (void *rd, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_data (rd, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to SECTOR of RAM disk RD. */
+static void
+ramdisk_write (void *rd, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_data (rd, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL
+  };
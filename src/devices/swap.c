@@ -52,9 +52,9 @@ swap_out (const void *vaddr)
   // calculate block sector from swap-slot number
   size_t sector = slot * PAGE_SECTORS;
   
-  // loop over each sector of the page, copying it from memory into swap
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_write (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
+  // copy the whole page from memory into swap with one request
+  struct block_iovec iov = { (void *) vaddr, PAGE_SECTORS };
+  block_write_multi (swap_device, sector, &iov, 1);
 
   return slot;
 }
@@ -66,9 +66,9 @@ swap_in (void *vaddr, size_t slot)
   // calculate block sector from swap-slot number
   size_t sector = slot * PAGE_SECTORS;
 
-  // loop over each sector of the page, copying it from swap into memory
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_read (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
+  // copy the whole page from swap into memory with one request
+  struct block_iovec iov = { vaddr, PAGE_SECTORS };
+  block_read_multi (swap_device, sector, &iov, 1);
   
   // clear the swap-slot previously used by this page
   swap_drop (slot);
@@ -84,6 +84,25 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of microseconds since the OS booted.  Unlike
+   timer_ticks(), this is finer than a timer tick, since it also
+   reads how far the PIT has counted into the current tick.  It may
+   briefly lag by a tick when the tick's interrupt is pending. */
+int64_t
+timer_usecs (void) 
+{
+  const unsigned period = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+  enum intr_level old_level = intr_disable ();
+  int64_t t = ticks;
+  unsigned count = pit_read_counter (0);
+  intr_set_level (old_level);
+
+  if (count == 0 || count > period)
+    count = period;
+  return (t * 1000000 / TIMER_FREQ
+          + (int64_t) (period - count) * 1000000 / PIT_HZ);
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
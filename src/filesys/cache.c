@@ -0,0 +1,498 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* How often the flusher thread writes dirty sectors back. */
+#define CACHE_FLUSH_TICKS (5 * TIMER_FREQ)
+
+/* Most sectors waiting for the read-ahead thread.  Requests made
+   while the queue is full are dropped. */
+#define READ_AHEAD_QUEUE_SIZE 32
+
+/* A cached sector of the file system device. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;              /* Sector held, if VALID. */
+    bool valid;                         /* Holds a sector. */
+    bool accessed;                      /* Used since the clock hand passed. */
+    int pin_cnt;                        /* Threads using or waiting for it. */
+    bool evicting;                      /* Writing back EVICTED. */
+    block_sector_t evicted;             /* Sector held before SECTOR. */
+
+    /* Protected by LOCK. */
+    struct lock lock;                   /* Held while DATA is in use. */
+    bool dirty;                         /* DATA differs from the disk and
+                                           is not logged. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects the sector to entry mapping, the pin counts and the
+   clock hand.  May be held while acquiring an entry's lock only if
+   that entry is not pinned by anybody else. */
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when a pin drops. */
+static struct condition cache_evicted;  /* Signaled after a write back. */
+static size_t clock_hand;               /* Next eviction candidate. */
+
+/* Sectors queued by cache_read_ahead, a ring protected by
+   read_ahead_lock. */
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t read_ahead_head;          /* Next sector to read. */
+static size_t read_ahead_cnt;           /* Sectors in the queue. */
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready; /* Signaled on a new request. */
+
+/* Requests and buffers of an in-progress cache_flush, too big for
+   a kernel stack, protected by flush_lock. */
+static struct block_request flush_requests[CACHE_SIZE];
+static struct block_iovec flush_iov[CACHE_SIZE];
+static struct lock flush_lock;
+
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static void cache_put (struct cache_entry *);
+static struct cache_entry *cache_evict (void);
+static bool cache_contains (block_sector_t);
+static struct cache_entry *cache_find (block_sector_t);
+static thread_func flusher_thread NO_RETURN;
+static thread_func read_ahead_thread NO_RETURN;
+
+/* Initializes the buffer cache and starts the thread that writes
+   dirty sectors back in the background. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  cond_init (&cache_evicted);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      lock_init (&cache[i].lock);
+      cache[i].valid = false;
+      cache[i].pin_cnt = 0;
+      cache[i].evicting = false;
+    }
+  lock_init (&read_ahead_lock);
+  lock_init (&flush_lock);
+  cond_init (&read_ahead_ready);
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of sector SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Reads sector SECTOR into BUFFER like cache_read, except that a
+   sector that is not cached is read straight from disk into BUFFER
+   and not brought into the cache.  Meant for large reads, whose data
+   is unlikely to be read again soon. */
+void
+cache_read_bypass (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *e = cache_find (sector);
+
+  if (e != NULL)
+    {
+      memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+      cache_put (e);
+    }
+  else
+    journal_read (sector, buffer);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to data sector SECTOR
+   like cache_write, except that a sector that is not cached is
+   written straight to disk, before this function returns, and not
+   brought into the cache.  Meant for large writes of sectors that
+   nobody reads while they are written. */
+void
+cache_write_bypass (block_sector_t sector, const void *buffer)
+{
+  struct cache_entry *e = cache_find (sector);
+
+  if (e != NULL)
+    {
+      memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+      e->dirty = true;
+      cache_put (e);
+    }
+  else
+    block_write (fs_device, sector, buffer);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR.
+   The disk is updated later by the flusher or on eviction. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFS of sector SECTOR.
+   The sector is only read from disk first if the write does not
+   cover all of it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFS of metadata sector
+   SECTOR, like cache_write_at, and logs the new contents of the
+   sector in the journal instead of marking it dirty: the journal
+   writes it to disk once it is committed.  Must be called inside a
+   journal handle. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer,
+                  size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = false;
+  journal_log (sector, e->data);
+  cache_put (e);
+}
+
+/* Writes every dirty sector back to disk.  Dirty sectors that are
+   consecutive on disk are written with a single request, and all
+   the requests are queued on the device before waiting for any of
+   them. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t locked_cnt = 0;
+  size_t req_cnt = 0;
+  size_t iov_cnt = 0;
+  size_t i, j;
+
+  lock_acquire (&flush_lock);
+
+  /* Pin the entries that look dirty, sorted by sector.  A pinned
+     entry keeps its sector, but whether it is dirty is only known
+     once its lock is held. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].dirty)
+      {
+        struct cache_entry *e = &cache[i];
+
+        e->pin_cnt++;
+        for (j = cnt++; j > 0 && dirty[j - 1]->sector > e->sector; j--)
+          dirty[j] = dirty[j - 1];
+        dirty[j] = e;
+      }
+  lock_release (&cache_lock);
+
+  /* Submit a request for each run of consecutive sectors.  Entry
+     locks are taken in ascending sector order, and nobody else holds
+     more than one, so this cannot deadlock.  The entries that stay
+     locked are moved to the front of DIRTY, which never overtakes
+     the entry being examined. */
+  for (i = 0; i < cnt; i = j)
+    {
+      size_t first = iov_cnt;
+      block_sector_t sector = 0;
+
+      for (j = i; j < cnt; j++)
+        {
+          struct cache_entry *e = dirty[j];
+
+          if (j > i && e->sector != dirty[j - 1]->sector + 1)
+            break;
+          lock_acquire (&e->lock);
+          if (e->dirty)
+            {
+              if (iov_cnt == first)
+                sector = e->sector;
+              flush_iov[iov_cnt].buffer = e->data;
+              flush_iov[iov_cnt].cnt = 1;
+              iov_cnt++;
+              dirty[locked_cnt++] = e;
+            }
+          else if (iov_cnt > first)
+            {
+              /* Cleaned meanwhile: end the run before it. */
+              lock_release (&e->lock);
+              break;
+            }
+          else
+            {
+              /* Cleaned meanwhile: start the run after it. */
+              cache_put (e);
+            }
+        }
+      if (iov_cnt > first)
+        {
+          struct block_request *r = &flush_requests[req_cnt++];
+
+          block_request_init (r, true, sector, flush_iov + first,
+                              iov_cnt - first, NULL, NULL);
+          block_submit (fs_device, r);
+        }
+    }
+
+  for (i = 0; i < req_cnt; i++)
+    block_wait (&flush_requests[i]);
+  for (i = 0; i < locked_cnt; i++)
+    {
+      dirty[i]->dirty = false;
+      cache_put (dirty[i]);
+    }
+
+  lock_release (&flush_lock);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache and
+   returns without waiting for it. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_QUEUE_SIZE)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_QUEUE_SIZE;
+      read_ahead_queue[tail] = sector;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_ready, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Returns true if SECTOR is in the cache or being read in. */
+static bool
+cache_contains (block_sector_t sector)
+{
+  bool found = false;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE && !found; i++)
+    found = cache[i].valid && cache[i].sector == sector;
+  lock_release (&cache_lock);
+  return found;
+}
+
+/* Returns the entry holding SECTOR with its lock held if SECTOR is
+   cached, or a null pointer if it is not.  Waits first for an
+   eviction of SECTOR in progress, as the disk is stale until it is
+   done. */
+static struct cache_entry *
+cache_find (block_sector_t sector) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      bool evicting = false;
+      size_t i;
+
+      e = NULL;
+      for (i = 0; i < CACHE_SIZE && e == NULL; i++)
+        if (cache[i].valid && cache[i].sector == sector)
+          e = &cache[i];
+        else if (cache[i].evicting && cache[i].evicted == sector)
+          evicting = true;
+
+      if (e != NULL || !evicting)
+        break;
+      cond_wait (&cache_evicted, &cache_lock);
+    }
+  if (e != NULL)
+    {
+      e->pin_cnt++;
+      e->accessed = true;
+    }
+  lock_release (&cache_lock);
+
+  if (e != NULL)
+    lock_acquire (&e->lock);
+  return e;
+}
+
+/* Returns the entry holding SECTOR with its lock held, bringing
+   the sector in if needed, from the journal if it has a newer
+   copy than the disk.  If LOAD is false the caller is about
+   to overwrite the whole sector, so a sector that is not cached
+   is not read from disk. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+  block_sector_t old_sector;
+  bool write_back;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      bool evicting = false;
+
+      for (i = 0; i < CACHE_SIZE; i++)
+        {
+          e = &cache[i];
+          if (e->valid && e->sector == sector)
+            {
+              e->pin_cnt++;
+              e->accessed = true;
+              lock_release (&cache_lock);
+              lock_acquire (&e->lock);
+              return e;
+            }
+          else if (e->evicting && e->evicted == sector)
+            evicting = true;
+        }
+
+      /* The disk is stale while SECTOR's last contents are on their
+         way out of the cache.  Either wait, like waiting for an
+         entry to evict, drops cache_lock, so look again after. */
+      if (evicting)
+        cond_wait (&cache_evicted, &cache_lock);
+      else if ((e = cache_evict ()) != NULL)
+        break;
+    }
+
+  /* Not cached: take over an unpinned entry.  Nobody else holds its
+     lock, and others looking for SECTOR find it and wait on the lock
+     until the data has been read in. */
+  old_sector = e->sector;
+  write_back = e->valid && e->dirty;
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  e->evicting = write_back;
+  e->evicted = old_sector;
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+
+  if (write_back)
+    {
+      block_write (fs_device, old_sector, e->data);
+      lock_acquire (&cache_lock);
+      e->evicting = false;
+      cond_broadcast (&cache_evicted, &cache_lock);
+      lock_release (&cache_lock);
+    }
+  if (load)
+    journal_read (sector, e->data);
+  e->dirty = false;
+  return e;
+}
+
+/* Releases entry E obtained from cache_get. */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Picks an entry to reuse with the clock algorithm, preferring
+   empty entries and skipping pinned ones.  If every entry is
+   pinned, waits for one to be unpinned and returns a null pointer,
+   since the cache may have changed meanwhile.  cache_lock must be
+   held. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (!cache[i].valid && cache[i].pin_cnt == 0)
+      return &cache[i];
+
+  /* Two sweeps clear every accessed bit, so an unpinned entry is
+     found unless all are pinned. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  cond_wait (&cache_unpinned, &cache_lock);
+  return NULL;
+}
+
+/* Periodically writes dirty sectors back so that a crash loses at
+   most a few seconds of writes. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CACHE_FLUSH_TICKS);
+      cache_flush ();
+    }
+}
+
+/* Reads the sectors queued by cache_read_ahead into the cache, so
+   that a sequential reader finds them there. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      if (!cache_contains (sector))
+        cache_put (cache_get (sector, true));
+    }
+}
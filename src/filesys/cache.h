@@ -0,0 +1,21 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, size_t ofs, size_t size);
+void cache_read_bypass (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_bypass (block_sector_t, const void *);
+void cache_write_meta (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_flush (void);
+void cache_read_ahead (block_sector_t);
+
+#endif /* filesys/cache.h */
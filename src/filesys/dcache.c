@@ -0,0 +1,117 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* A cached result of looking up NAME in the directory whose inode
+   is in sector PARENT.  Negative entries record that the name does
+   not exist, so that looking for a missing file repeatedly does not
+   search the directory each time. */
+struct dcache_entry
+  {
+    bool valid;                         /* Holds a name. */
+    bool negative;                      /* NAME does not exist. */
+    block_sector_t parent;              /* Directory searched. */
+    block_sector_t sector;              /* Inode of NAME, if positive. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* The cache is direct mapped: a name can only be held in the slot
+   its hash selects, and a new name replaces whatever was there. */
+static struct dcache_entry dcache[DCACHE_SIZE];
+
+/* Protects DCACHE. */
+static struct lock dcache_lock;
+
+/* Returns the slot for NAME in PARENT. */
+static struct dcache_entry *
+dcache_slot (block_sector_t parent, const char *name) 
+{
+  return &dcache[(hash_string (name) ^ hash_int (parent)) % DCACHE_SIZE];
+}
+
+/* Returns true if E holds NAME in PARENT. */
+static bool
+dcache_match (const struct dcache_entry *e, block_sector_t parent,
+              const char *name) 
+{
+  return e->valid && e->parent == parent && !strcmp (e->name, name);
+}
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+   Returns DCACHE_FOUND and sets *SECTOR to the inode sector of
+   NAME, DCACHE_ABSENT if NAME is known not to exist, or DCACHE_MISS
+   if the directory itself has to be searched. */
+enum dcache_result
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sector) 
+{
+  struct dcache_entry *e = dcache_slot (parent, name);
+  enum dcache_result result = DCACHE_MISS;
+
+  lock_acquire (&dcache_lock);
+  if (dcache_match (e, parent, name))
+    {
+      result = e->negative ? DCACHE_ABSENT : DCACHE_FOUND;
+      *sector = e->sector;
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Stores an entry for NAME in PARENT, which is negative if
+   NEGATIVE is true. */
+static void
+dcache_store (block_sector_t parent, const char *name, bool negative,
+              block_sector_t sector) 
+{
+  struct dcache_entry *e = dcache_slot (parent, name);
+
+  if (strlen (name) > NAME_MAX)
+    return;
+  lock_acquire (&dcache_lock);
+  e->valid = true;
+  e->negative = negative;
+  e->parent = parent;
+  e->sector = sector;
+  strlcpy (e->name, name, sizeof e->name);
+  lock_release (&dcache_lock);
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT has its inode in SECTOR. */
+void
+dcache_add (block_sector_t parent, const char *name, block_sector_t sector) 
+{
+  dcache_store (parent, name, false, sector);
+}
+
+/* Records that the directory whose inode is in sector PARENT has
+   no entry named NAME. */
+void
+dcache_add_negative (block_sector_t parent, const char *name) 
+{
+  dcache_store (parent, name, true, 0);
+}
+
+/* Forgets anything known about NAME in PARENT.  Must be called
+   whenever an entry is added to or removed from a directory. */
+void
+dcache_invalidate (block_sector_t parent, const char *name) 
+{
+  struct dcache_entry *e = dcache_slot (parent, name);
+
+  lock_acquire (&dcache_lock);
+  if (dcache_match (e, parent, name))
+    e->valid = false;
+  lock_release (&dcache_lock);
+}
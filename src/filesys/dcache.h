@@ -0,0 +1,26 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of names held in the directory entry cache. */
+#define DCACHE_SIZE 256
+
+/* Result of dcache_lookup. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Not cached, search the directory. */
+    DCACHE_FOUND,               /* Name exists, *SECTOR is its inode. */
+    DCACHE_ABSENT               /* Name is known not to exist. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (block_sector_t parent, const char *name,
+                                  block_sector_t *sector);
+void dcache_add (block_sector_t parent, const char *name,
+                 block_sector_t sector);
+void dcache_add_negative (block_sector_t parent, const char *name);
+void dcache_invalidate (block_sector_t parent, const char *name);
+
+#endif /* filesys/dcache.h */
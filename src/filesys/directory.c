@@ -2,15 +2,42 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* A directory is a hash table of entries kept in its file.  The
+   first sector holds a struct dir_header.  Each following sector is
+   a bucket of entries: the name hashes to one of BUCKET_CNT primary
+   buckets, so a lookup usually reads a single sector.  A full bucket
+   is chained to an overflow bucket allocated past the primary ones.
+   The directory grows by linear hashing: whenever the primary
+   buckets fill up past DIR_MAX_LOAD percent, one more is added and
+   only the entries of one bucket are rehashed, so that growing
+   takes a small, bounded part of a journal transaction however
+   large the directory is. */
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0x44495248
+
+/* Percentage of the primary bucket slots that may be in use before
+   the directory is grown. */
+#define DIR_MAX_LOAD 75
+
+/* Longest bucket chain that is split.  Splitting rewrites the chain
+   and the new bucket and may move one overflow bucket, which
+   together with the entry being added fits in DIR_ADD_SECTORS. */
+#define SPLIT_MAX_CHAIN 8
+
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    off_t pos;                          /* Index of the next slot for
+                                           dir_readdir. */
   };
 
 /* A single directory entry. */
@@ -21,21 +48,152 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory header, at the start of the directory's first sector. */
+struct dir_header
+  {
+    unsigned magic;                     /* DIR_MAGIC. */
+    block_sector_t parent;              /* Inode sector of the parent. */
+    uint32_t bucket_cnt;                /* Number of primary buckets. */
+    uint32_t overflow_cnt;              /* Overflow buckets after them. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+  };
+
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRIES ((BLOCK_SECTOR_SIZE - sizeof (uint32_t))        \
+                        / sizeof (struct dir_entry))
+
+/* A bucket, stored in one sector.  Bucket B is sector B of the
+   directory's file, so bucket numbers start at 1. */
+struct dir_bucket
+  {
+    uint32_t next;                      /* Overflow bucket, 0 if none. */
+    struct dir_entry entries[BUCKET_ENTRIES];
+  };
+
+/* Returns the byte offset of slot SLOT of bucket BUCKET. */
+static inline off_t
+slot_ofs (uint32_t bucket, size_t slot) 
+{
+  return (bucket * BLOCK_SECTOR_SIZE + offsetof (struct dir_bucket, entries)
+          + slot * sizeof (struct dir_entry));
+}
+
+/* Reads the header of DIR into *H.  Returns false if DIR does not
+   hold a valid directory. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) 
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Writes H as the header of DIR.  Returns true if successful. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h) 
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Reads bucket BUCKET of DIR into *B.  Returns true if successful. */
+static bool
+read_bucket (const struct dir *dir, uint32_t bucket, struct dir_bucket *b) 
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, bucket * BLOCK_SECTOR_SIZE)
+          == sizeof *b);
+}
+
+/* Writes B as bucket BUCKET of DIR.  Returns true if successful. */
+static bool
+write_bucket (struct dir *dir, uint32_t bucket, const struct dir_bucket *b) 
+{
+  return (inode_write_at (dir->inode, b, sizeof *b, bucket * BLOCK_SECTOR_SIZE)
+          == sizeof *b);
+}
+
+/* Returns the largest power of 2 that is not above the number of
+   primary buckets in H.  Primary buckets LOW + 1 and up were split
+   off buckets 1 and up, in order. */
+static uint32_t
+low_buckets (const struct dir_header *h) 
+{
+  uint32_t low = 1;
+
+  while (low * 2 <= h->bucket_cnt)
+    low *= 2;
+  return low;
+}
+
+/* Returns the primary bucket for NAME: its hash modulo twice
+   low_buckets if there is such a bucket yet, otherwise modulo
+   low_buckets. */
+static uint32_t
+home_bucket (const struct dir_header *h, const char *name) 
+{
+  unsigned hash = hash_string (name);
+  uint32_t low = low_buckets (h);
+  uint32_t bucket = hash % (low * 2);
+
+  if (bucket >= h->bucket_cnt)
+    bucket = hash % low;
+  return bucket + 1;
+}
+
+/* Returns the number of primary buckets for a new directory with
+   space for ENTRY_CNT entries. */
+static uint32_t
+initial_buckets (size_t entry_cnt) 
+{
+  uint32_t bucket_cnt = 1;
+
+  while (bucket_cnt * BUCKET_ENTRIES * DIR_MAX_LOAD / 100 < entry_cnt)
+    bucket_cnt *= 2;
+  return bucket_cnt;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory is in sector PARENT.  The
+   directory grows beyond ENTRY_CNT entries as needed.  Returns
+   true if successful, false on failure.  Must be called inside a
+   journal handle that reserved dir_create_cost (ENTRY_CNT)
+   sectors for it. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
+{
+  struct dir_header h;
+  struct dir *dir;
+  bool success;
+
+  h.magic = DIR_MAGIC;
+  h.parent = parent;
+  h.bucket_cnt = initial_buckets (entry_cnt);
+  h.overflow_cnt = 0;
+  h.entry_cnt = 0;
+
+  if (!inode_create (sector, (h.bucket_cnt + 1) * BLOCK_SECTOR_SIZE, true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = dir != NULL && write_header (dir, &h);
+  dir_close (dir);
+  return success;
+}
+
+/* Returns at most how many metadata sectors dir_create changes
+   for a directory with space for ENTRY_CNT entries. */
+size_t
+dir_create_cost (size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  return inode_create_cost ((initial_buckets (entry_cnt) + 1)
+                            * BLOCK_SECTOR_SIZE, true);
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure, which
+   includes INODE not being a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
   struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -83,109 +241,343 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Searches DIR, whose header is H, for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
    otherwise, returns false and ignores EP and OFSP. */
 static bool
-lookup (const struct dir *dir, const char *name,
+lookup (const struct dir *dir, const struct dir_header *h, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_bucket b;
+  uint32_t bucket;
+  size_t i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  for (bucket = home_bucket (h, name); bucket != 0; bucket = b.next)
+    {
+      off_t ofs = bucket * BLOCK_SECTOR_SIZE;
+
+      if (inode_read_at (dir->inode, &b, sizeof b, ofs) != sizeof b)
+        return false;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (b.entries[i].in_use && !strcmp (name, b.entries[i].name)) 
+          {
+            if (ep != NULL)
+              *ep = b.entries[i];
+            if (ofsp != NULL)
+              *ofsp = slot_ofs (bucket, i);
+            return true;
+          }
+    }
+  return false;
+}
+
+/* Stores E in a free slot of the bucket chain for its name in DIR,
+   whose header is H, adding an overflow bucket to the chain if all
+   of its buckets are full.  Updates H but does not write it.
+   Returns true if successful, false if a disk error occurs. */
+static bool
+insert (struct dir *dir, struct dir_header *h, const struct dir_entry *e) 
+{
+  static const struct dir_bucket empty;
+  struct dir_bucket b;
+  uint32_t bucket = home_bucket (h, e->name);
+  size_t i;
+
+  for (;;)
+    {
+      if (inode_read_at (dir->inode, &b, sizeof b,
+                         bucket * BLOCK_SECTOR_SIZE) != sizeof b)
+        return false;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (!b.entries[i].in_use)
+          goto found;
+      if (b.next == 0)
+        break;
+      bucket = b.next;
+    }
+
+  /* Every bucket in the chain is full: link a new, empty one to its
+     end.  It is written whole first, so that the file covers it. */
+  b.next = h->bucket_cnt + h->overflow_cnt + 1;
+  if (!write_bucket (dir, b.next, &empty)
+      || inode_write_at (dir->inode, &b.next, sizeof b.next,
+                         bucket * BLOCK_SECTOR_SIZE) != sizeof b.next)
+    return false;
+  h->overflow_cnt++;
+  bucket = b.next;
+  i = 0;
+
+ found:
+  if (inode_write_at (dir->inode, e, sizeof *e, slot_ofs (bucket, i))
+      != sizeof *e)
+    return false;
+  h->entry_cnt++;
+  return true;
+}
+
+/* Moves overflow bucket FROM of DIR, whose header is H, to bucket
+   TO, which is past the last one, and relinks the chain it is in.
+   Leaves DIR unchanged and returns false if disk space runs out. */
+static bool
+move_bucket (struct dir *dir, const struct dir_header *h,
+             uint32_t from, uint32_t to) 
+{
+  struct dir_bucket b, prev;
+  uint32_t prev_bucket = 0;
+  uint32_t bucket;
+  size_t i;
+
+  if (!read_bucket (dir, from, &b))
+    return false;
+
+  /* Find the bucket linking to FROM in the chain of the names it
+     holds or, if it is empty, among all of them. */
+  for (i = 0; i < BUCKET_ENTRIES; i++)
+    if (b.entries[i].in_use)
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
+        bucket = home_bucket (h, b.entries[i].name);
+        for (; bucket != 0 && read_bucket (dir, bucket, &prev);
+             bucket = prev.next)
+          if (prev.next == from)
+            {
+              prev_bucket = bucket;
+              break;
+            }
+        break;
       }
-  return false;
+  for (bucket = 1;
+       prev_bucket == 0 && bucket <= h->bucket_cnt + h->overflow_cnt;
+       bucket++)
+    if (read_bucket (dir, bucket, &prev) && prev.next == from)
+      prev_bucket = bucket;
+  if (prev_bucket == 0 || !write_bucket (dir, to, &b))
+    return false;
+  return (inode_write_at (dir->inode, &to, sizeof to,
+                          prev_bucket * BLOCK_SECTOR_SIZE) == sizeof to);
+}
+
+/* Writes the ENTRY_CNT entries in ENTRIES, in order, to the chain
+   of DIR made of the BUCKET_CNT buckets in BUCKETS, clearing their
+   other slots.  The entries must fit. */
+static void
+fill_chain (struct dir *dir, const uint32_t *buckets, size_t bucket_cnt,
+            const struct dir_entry *entries, size_t entry_cnt) 
+{
+  struct dir_bucket b;
+  size_t i, slot;
+
+  ASSERT (entry_cnt <= bucket_cnt * BUCKET_ENTRIES);
+  for (i = 0; i < bucket_cnt; i++)
+    {
+      memset (&b, 0, sizeof b);
+      b.next = i + 1 < bucket_cnt ? buckets[i + 1] : 0;
+      for (slot = 0; slot < BUCKET_ENTRIES && entry_cnt > 0; slot++)
+        {
+          b.entries[slot] = *entries++;
+          entry_cnt--;
+        }
+      write_bucket (dir, buckets[i], &b);
+    }
+}
+
+/* Adds a primary bucket to DIR, whose header is H, and splits the
+   chain of the next bucket in turn between that bucket and the new
+   one, reusing the chain's overflow buckets.  An overflow bucket in
+   the place of the new one is moved past the last bucket first.
+   Updates H but does not write it.  Leaves DIR unchanged and
+   returns false if the chain is longer than SPLIT_MAX_CHAIN or if
+   memory or disk space runs out. */
+static bool
+split (struct dir *dir, struct dir_header *h) 
+{
+  static const struct dir_bucket empty;
+  uint32_t chain[SPLIT_MAX_CHAIN];
+  uint32_t old_bucket = h->bucket_cnt - low_buckets (h) + 1;
+  uint32_t new_bucket = h->bucket_cnt + 1;
+  struct dir_entry *entries;
+  struct dir_bucket b;
+  size_t chain_cnt = 0;
+  size_t entry_cnt = 0;
+  size_t keep, moved_buckets, i;
+  uint32_t bucket;
+
+  for (bucket = old_bucket; bucket != 0; bucket = b.next)
+    {
+      if (chain_cnt == SPLIT_MAX_CHAIN || !read_bucket (dir, bucket, &b))
+        return false;
+      chain_cnt++;
+    }
+  entries = malloc (chain_cnt * BUCKET_ENTRIES * sizeof *entries);
+  if (entries == NULL)
+    return false;
+
+  /* Claim the new bucket.  This extends the file, the only step
+     that can run out of disk space. */
+  if (h->overflow_cnt > 0
+      ? !move_bucket (dir, h, new_bucket,
+                      h->bucket_cnt + h->overflow_cnt + 1)
+      : !write_bucket (dir, new_bucket, &empty))
+    {
+      free (entries);
+      return false;
+    }
+
+  /* Collect the chain, which may have had a bucket moved. */
+  chain_cnt = 0;
+  for (bucket = old_bucket;
+       bucket != 0 && chain_cnt < SPLIT_MAX_CHAIN
+         && read_bucket (dir, bucket, &b);
+       bucket = b.next)
+    {
+      chain[chain_cnt++] = bucket;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (b.entries[i].in_use)
+          entries[entry_cnt++] = b.entries[i];
+    }
+
+  /* Put the entries that stay first. */
+  h->bucket_cnt++;
+  keep = 0;
+  for (i = 0; i < entry_cnt; i++)
+    if (home_bucket (h, entries[i].name) == old_bucket)
+      {
+        struct dir_entry e = entries[i];
+        entries[i] = entries[keep];
+        entries[keep++] = e;
+      }
+
+  /* The new bucket's chain takes as many overflow buckets from the
+     end of the old chain as it needs.  The two chains never need
+     more buckets than the old chain and the new bucket, so the old
+     chain keeps at least its primary bucket and enough room. */
+  moved_buckets = entry_cnt - keep > BUCKET_ENTRIES
+                  ? DIV_ROUND_UP (entry_cnt - keep, BUCKET_ENTRIES) - 1 : 0;
+  fill_chain (dir, chain, chain_cnt - moved_buckets, entries, keep);
+  chain[chain_cnt - moved_buckets - 1] = new_bucket;
+  fill_chain (dir, chain + chain_cnt - moved_buckets - 1, moved_buckets + 1,
+              entries + keep, entry_cnt - keep);
+  free (entries);
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." and ".." name DIR itself and its parent.  Other names are
+   looked up in the directory entry cache first, and the result
+   of searching DIR is added to it.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent, sector;
+  struct dir_header h;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  parent = inode_get_inumber (dir->inode);
+  *inode = NULL;
+  inode_lock_dir (dir->inode);
+  if (!strcmp (name, "."))
+    *inode = inode_reopen (dir->inode);
   else
-    *inode = NULL;
+    switch (dcache_lookup (parent, name, &sector))
+      {
+      case DCACHE_FOUND:
+        *inode = inode_open (sector);
+        break;
+
+      case DCACHE_ABSENT:
+        break;
+
+      case DCACHE_MISS:
+        if (!read_header (dir, &h))
+          break;
+        if (!strcmp (name, ".."))
+          *inode = inode_open (h.parent);
+        else if (lookup (dir, &h, name, &e, NULL))
+          {
+            dcache_add (parent, name, e.inode_sector);
+            *inode = inode_open (e.inode_sector);
+          }
+        else
+          dcache_add_negative (parent, name);
+        break;
+      }
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR.  Must be called inside a journal handle that
+   reserved DIR_ADD_SECTORS sectors for it.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long, or "." or "..") or a
+   disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX || strchr (name, '/')
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock_dir (dir->inode);
+  if (!read_header (dir, &h) || lookup (dir, &h, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Keep chains short.  If splitting fails the entry still fits in
+     an overflow bucket.  The header is written at once, because the
+     split has moved entries whatever happens next. */
+  if ((h.entry_cnt + 1) * 100 > h.bucket_cnt * BUCKET_ENTRIES * DIR_MAX_LOAD
+      && split (dir, &h))
+    write_header (dir, &h);
+
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  success = insert (dir, &h, &e) && write_header (dir, &h);
 
  done:
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, or if it is a directory
+   that is not empty or is open elsewhere, for example as the
+   working directory of a process.  Must be called inside a journal
+   handle.  On success the removed inode is stored in *INODEP; the
+   caller closes it after the handle has ended, because closing the
+   last reference releases its sectors under journal handles of its
+   own. */
 bool
-dir_remove (struct dir *dir, const char *name) 
+dir_remove (struct dir *dir, const char *name, struct inode **inodep) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool child_locked = false;
   bool success = false;
   off_t ofs;
 
@@ -193,7 +585,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock_dir (dir->inode);
+  if (!read_header (dir, &h) || !lookup (dir, &h, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,36 +594,81 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove a directory nobody else is using.  Its lock is
+     held until it is marked removed, so that nothing is added to it
+     meanwhile. */
+  if (inode_is_dir (inode))
+    {
+      struct dir *child = dir_open (inode_reopen (inode));
+      struct dir_header child_h;
+      bool busy;
+
+      if (child == NULL)
+        goto done;
+      inode_lock_dir (inode);
+      busy = (!read_header (child, &child_h) || child_h.entry_cnt > 0
+              || inode_open_cnt (inode) > 2);
+      dir_close (child);
+      if (busy)
+        {
+          inode_unlock_dir (inode);
+          goto done;
+        }
+      child_locked = true;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  h.entry_cnt--;
+  write_header (dir, &h);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
-  inode_close (inode);
+  if (child_locked)
+    inode_unlock_dir (inode);
+  if (success)
+    *inodep = inode;
+  else
+    inode_close (inode);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  "." and ".." are not returned. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  inode_lock_dir (dir->inode);
+  if (read_header (dir, &h))
+    for (;;)
+      {
+        uint32_t bucket = dir->pos / BUCKET_ENTRIES + 1;
+        size_t slot = dir->pos % BUCKET_ENTRIES;
+
+        if (bucket > h.bucket_cnt + h.overflow_cnt
+            || inode_read_at (dir->inode, &e, sizeof e,
+                              slot_ofs (bucket, slot)) != sizeof e)
+          break;
+        dir->pos++;
+        if (e.in_use)
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            success = true;
+            break;
+          } 
+      }
+  inode_unlock_dir (dir->inode);
+  return success;
 }
@@ -11,10 +11,16 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* Most metadata sectors that dir_add changes, which the journal
+   handle around it must reserve. */
+#define DIR_ADD_SECTORS 24
+
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector, block_sector_t parent,
+                 size_t entry_cnt);
+size_t dir_create_cost (size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -24,7 +30,7 @@ struct inode *dir_get_inode (struct dir *);
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
-bool dir_remove (struct dir *, const char *name);
+bool dir_remove (struct dir *, const char *name, struct inode **);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
 #endif /* filesys/directory.h */
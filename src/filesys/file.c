@@ -1,17 +1,31 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "devices/block.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include <hash.h>
 
+/* Read-ahead window, in bytes, once sequential reading is seen.
+   It doubles on every further sequential read up to the maximum. */
+#define READ_AHEAD_MIN (2 * BLOCK_SECTOR_SIZE)
+#define READ_AHEAD_MAX (16 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
+
+    /* Protected by LOCK. */
+    struct lock lock;
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_window;            /* Bytes to read ahead, 0 if not sequential. */
+    off_t ra_end;               /* End of the bytes already queued. */
   };
 
+static void file_read_ahead (struct file *);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -22,8 +36,11 @@ file_open (struct inode *inode)
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
+      lock_init (&file->lock);
       file->pos = 0;
       file->deny_write = false;
+      file->ra_window = 0;
+      file->ra_end = 0;
       return file;
     }
   else
@@ -69,11 +86,36 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  lock_acquire (&file->lock);
+  bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file_read_ahead (file);
+  lock_release (&file->lock);
   return bytes_read;
 }
 
+/* Called after each file_read.  Reading picks up where the last
+   one stopped unless the file was seeked, so grow the window and
+   queue the sectors after FILE's position that are not queued
+   yet.  FILE's lock must be held. */
+static void
+file_read_ahead (struct file *file) 
+{
+  off_t start;
+
+  if (file->ra_window == 0)
+    file->ra_window = READ_AHEAD_MIN;
+  else if (file->ra_window < READ_AHEAD_MAX)
+    file->ra_window *= 2;
+
+  start = file->ra_end > file->pos ? file->ra_end : file->pos;
+  file->ra_end = file->pos + file->ra_window;
+  if (start < file->ra_end)
+    inode_read_ahead (file->inode, file->ra_end - start, start);
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -88,24 +130,26 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
+   Advances FILE's position by the number of bytes written. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  lock_acquire (&file->lock);
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
+  lock_release (&file->lock);
   return bytes_written;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -120,11 +164,13 @@ void
 file_deny_write (struct file *file) 
 {
   ASSERT (file != NULL);
+  lock_acquire (&file->lock);
   if (!file->deny_write) 
     {
       file->deny_write = true;
       inode_deny_write (file->inode);
     }
+  lock_release (&file->lock);
 }
 
 /* Re-enables write operations on FILE's underlying inode.
@@ -134,11 +180,13 @@ void
 file_allow_write (struct file *file) 
 {
   ASSERT (file != NULL);
+  lock_acquire (&file->lock);
   if (file->deny_write) 
     {
       file->deny_write = false;
       inode_allow_write (file->inode);
     }
+  lock_release (&file->lock);
 }
 
 /* Returns the size of FILE in bytes. */
@@ -156,7 +204,15 @@ file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
+  lock_acquire (&file->lock);
+  if (new_pos != file->pos)
+    {
+      /* A seek ends sequential reading. */
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
   file->pos = new_pos;
+  lock_release (&file->lock);
 }
 
 /* Returns the current position in FILE as a byte offset from the
@@ -164,8 +220,13 @@ file_seek (struct file *file, off_t new_pos)
 off_t
 file_tell (struct file *file) 
 {
+  off_t pos;
+
   ASSERT (file != NULL);
-  return file->pos;
+  lock_acquire (&file->lock);
+  pos = file->pos;
+  lock_release (&file->lock);
+  return pos;
 }
 
 /* Checks if two file structs are referencing the same underlying file */
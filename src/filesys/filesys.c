@@ -2,15 +2,26 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Metadata sectors that creating a file or directory changes
+   besides its inode: the free map sector for the inode and the
+   new directory entry. */
+#define CREATE_SECTORS (1 + DIR_ADD_SECTORS)
+
 static void do_format (void);
+static bool resolve_parent (const char *path, struct dir **dirp,
+                            char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +32,10 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dcache_init ();
+  journal_init (format);
   free_map_init ();
 
   if (format) 
@@ -36,29 +50,87 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
+   NAME is a path, absolute or relative to the current directory.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   or if internal memory allocation fails.
+   The new file appears atomically, as one journal handle, unless
+   its index is too large for one journal transaction.  Such a file
+   appears empty and is then extended to INITIAL_SIZE by
+   inode_extend, and it is removed again if the disk fills up. */
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char file_name[NAME_MAX + 1];
+  off_t length = initial_size;
+  struct dir *dir;
+  bool success;
+
+  if (!resolve_parent (name, &dir, file_name))
+    return false;
+  if (CREATE_SECTORS + inode_create_cost (length, false) > JOURNAL_TXN_MAX)
+    length = 0;
+  journal_begin_reserve (CREATE_SECTORS + inode_create_cost (length, false));
+  success = (free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, length, false)
+             && dir_add (dir, file_name, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  journal_end ();
+
+  if (success && length < initial_size)
+    {
+      struct inode *inode = inode_open (inode_sector);
+
+      success = inode != NULL && inode_extend (inode, initial_size);
+      inode_close (inode);
+      if (!success)
+        {
+          struct inode *removed = NULL;
+
+          journal_begin ();
+          dir_remove (dir, file_name, &removed);
+          journal_end ();
+          inode_close (removed);
+        }
+    }
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a directory named NAME, a path like for
+   filesys_create.  Returns true if successful, false otherwise. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char dir_name[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  if (!resolve_parent (name, &dir, dir_name))
+    return false;
+  journal_begin_reserve (CREATE_SECTORS + dir_create_cost (16));
+  success = (free_map_allocate (1, &inode_sector)
+             && dir_create (inode_sector,
+                            inode_get_inumber (dir_get_inode (dir)), 16)
+             && dir_add (dir, dir_name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,38 +138,148 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char file_name[NAME_MAX + 1];
+  struct dir *dir;
   struct inode *inode = NULL;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+  if (resolve_parent (name, &dir, file_name))
+    dir_lookup (dir, file_name, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char file_name[NAME_MAX + 1];
+  struct inode *inode = NULL;
+  struct dir *dir;
+  bool success;
+
+  if (!resolve_parent (name, &dir, file_name))
+    return false;
+  journal_begin ();
+  success = dir_remove (dir, file_name, &inode);
+  journal_end ();
   dir_close (dir); 
+  inode_close (inode);
 
   return success;
 }
 
+/* Makes the directory named NAME the current directory of the
+   running thread.  Returns true if successful, false otherwise. */
+bool
+filesys_chdir (const char *name) 
+{
+  char dir_name[NAME_MAX + 1];
+  struct dir *dir;
+  struct inode *inode = NULL;
+  struct dir *cwd;
+
+  if (resolve_parent (name, &dir, dir_name))
+    dir_lookup (dir, dir_name, &inode);
+  dir_close (dir);
+
+  cwd = dir_open (inode);
+  if (cwd == NULL)
+    return false;
+  dir_close (thread_current ()->cwd);
+  thread_current ()->cwd = cwd;
+  return true;
+}
+
+/* Copies the next component of path *SRCP into PART and advances
+   *SRCP past it, skipping leading slashes.  Returns 1 on success,
+   0 at the end of the path, -1 if the component is longer than
+   NAME_MAX. */
+static int
+next_part (char part[NAME_MAX + 1], const char **srcp) 
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory holding the last component of PATH and
+   stores it in *DIRP, and copies the last component to NAME.  A
+   PATH starting with "/" is looked up from the root directory,
+   others from the running thread's current directory.  A PATH
+   that names the root directory gives the root and ".".
+   Returns false if PATH is empty, a directory on the way does not
+   exist or a component is too long; *DIRP is then a null
+   pointer. */
+static bool
+resolve_parent (const char *path, struct dir **dirp, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int result;
+
+  *dirp = NULL;
+  if (*path == '\0')
+    return false;
+  if (*path == '/' || cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (cwd);
+  if (dir == NULL)
+    return false;
+
+  result = next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (result > 0 && (result = next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return false;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    {
+      dir_close (dir);
+      return false;
+    }
+  *dirp = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_begin ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_end ();
   printf ("done.\n");
 }
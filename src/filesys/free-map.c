@@ -4,19 +4,50 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *in_use;        /* FREE_MAP, RELEASED, reserved. */
+static struct bitmap *released;      /* Released, not yet committed. */
+static size_t released_cnt;          /* Bits set in RELEASED. */
+static struct lock free_map_lock;    /* Protects the above. */
+
+/* Every change to FREE_MAP is written to FREE_MAP_FILE right away,
+   but only the words holding the changed bits.  The free map is
+   metadata, so the writes are logged in the journal and must be
+   made inside a journal handle.
+
+   A released sector is not allocated again until the transaction
+   that released it has committed: until then a crash could bring
+   back its old owner, which must not find the data of a new one
+   there, because file data is not logged.  Allocations therefore
+   search IN_USE, which keeps such sectors marked until
+   free_map_commit.
+
+   An extent reserved for a file's growth is only marked in IN_USE.
+   Its sectors reach FREE_MAP one at a time as they are claimed, in
+   the same transaction that links them into an inode, so a crash
+   never leaves a reserved sector that nothing refers to marked on
+   disk. */
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  in_use = bitmap_create (block_size (fs_device));
+  released = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || in_use == NULL || released == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SIZE + 1, true);
+  bitmap_mark (in_use, FREE_MAP_SECTOR);
+  bitmap_mark (in_use, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (in_use, JOURNAL_SECTOR, JOURNAL_SIZE + 1, true);
+  lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,26 +58,146 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (in_use, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (free_map_file != NULL
+          && !bitmap_write_range (free_map, free_map_file, sector, cnt))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false); 
+          bitmap_set_multiple (in_use, sector, cnt, false); 
+          sector = BITMAP_ERROR;
+        }
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Reserves a run of up to MAX_CNT consecutive sectors into *EXT,
+   placed as close after sector GOAL as possible.  A free run of
+   the full MAX_CNT sectors is preferred, searching from GOAL and
+   then from the start of the disk; failing that, the first free
+   sector at or after GOAL and whatever free sectors follow it are
+   taken.  The sectors are kept from other allocations but stay
+   free on disk until free_map_claim; free_map_unreserve gives
+   back those never claimed.
+   Returns false if the disk is full. */
+bool
+free_map_reserve_extent (block_sector_t goal, size_t max_cnt,
+                         struct extent *ext)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start, cnt;
+  bool success = false;
+
+  ASSERT (max_cnt > 0);
+  if (goal >= size)
+    goal = 0;
+
+  lock_acquire (&free_map_lock);
+  cnt = max_cnt;
+  start = bitmap_scan (in_use, goal, cnt, false);
+  if (start == BITMAP_ERROR)
+    start = bitmap_scan (in_use, 0, cnt, false);
+  if (start == BITMAP_ERROR)
+    {
+      start = bitmap_scan (in_use, goal, 1, false);
+      if (start == BITMAP_ERROR)
+        start = bitmap_scan (in_use, 0, 1, false);
+      if (start == BITMAP_ERROR)
+        goto done;
+      for (cnt = 1; cnt < max_cnt && start + cnt < size
+                    && !bitmap_test (in_use, start + cnt); cnt++)
+        continue;
+    }
+
+  bitmap_set_multiple (in_use, start, cnt, true);
+  ext->start = start;
+  ext->cnt = cnt;
+  success = true;
+
+ done:
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Marks SECTOR, reserved by free_map_reserve_extent, as allocated
+   on disk.  Returns false if the free_map file could not be
+   written, in which case SECTOR stays reserved. */
+bool
+free_map_claim (block_sector_t sector) 
+{
+  bool success = true;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_test (in_use, sector) && !bitmap_test (free_map, sector));
+  bitmap_mark (free_map, sector);
+  if (free_map_file != NULL
+      && !bitmap_write_range (free_map, free_map_file, sector, 1))
+    {
+      bitmap_reset (free_map, sector);
+      success = false;
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Gives back CNT reserved sectors starting at SECTOR that were
+   never claimed.  They were never marked on disk, so they can be
+   used again at once. */
+void
+free_map_unreserve (block_sector_t sector, size_t cnt) 
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_all (in_use, sector, cnt));
+  ASSERT (bitmap_none (free_map, sector, cnt));
+  bitmap_set_multiple (in_use, sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the running journal transaction has committed. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (free_map_file != NULL)
+    {
+      bitmap_write_range (free_map, free_map_file, sector, cnt);
+      bitmap_set_multiple (released, sector, cnt, true);
+      released_cnt += cnt;
+    }
+  else
+    bitmap_set_multiple (in_use, sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Makes the sectors released so far available for allocation.
+   Called by the journal once the transaction that released them
+   has committed. */
+void
+free_map_commit (void) 
+{
+  size_t sector = 0;
+
+  lock_acquire (&free_map_lock);
+  while (released_cnt > 0)
+    {
+      sector = bitmap_scan (released, sector, 1, true);
+      ASSERT (sector != BITMAP_ERROR);
+      bitmap_reset (released, sector);
+      bitmap_reset (in_use, sector);
+      released_cnt--;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,7 +207,8 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, free_map_file)
+      || !bitmap_read (in_use, free_map_file))
     PANIC ("can't read free map");
 }
 
@@ -73,7 +225,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
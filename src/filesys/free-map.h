@@ -11,7 +11,19 @@ void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
+/* A run of consecutive sectors. */
+struct extent
+  {
+    block_sector_t start;       /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+  };
+
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_reserve_extent (block_sector_t goal, size_t max_cnt,
+                              struct extent *);
+bool free_map_claim (block_sector_t);
+void free_map_unreserve (block_sector_t, size_t);
 void free_map_release (block_sector_t, size_t);
+void free_map_commit (void);
 
 #endif /* filesys/free-map.h */
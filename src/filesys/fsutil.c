@@ -1,9 +1,11 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -11,6 +13,13 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Pages of file data that fsutil_extract reads from the scratch
+   device with one request and writes to the file system with one
+   call.  It uses two such buffers, reading into one while writing
+   the other. */
+#define EXTRACT_PAGES 16
+#define EXTRACT_SIZE (EXTRACT_PAGES * PGSIZE)
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -66,6 +75,24 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Starts reading the first EXTRACT_SIZE bytes of the SIZE bytes
+   of file data at SECTOR of SRC into BUFFER, with request R and its
+   I/O vector IOV, and returns without waiting.  Returns the number
+   of bytes being read. */
+static int
+start_extract_read (struct block *src, block_sector_t sector, int size,
+                    void *buffer, struct block_request *r,
+                    struct block_iovec *iov)
+{
+  int chunk_size = size < EXTRACT_SIZE ? size : EXTRACT_SIZE;
+
+  iov->buffer = buffer;
+  iov->cnt = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+  block_request_init (r, false, sector, iov, 1, NULL, NULL);
+  block_submit (src, r);
+  return chunk_size;
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -74,12 +101,18 @@ fsutil_extract (char **argv UNUSED)
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  void *header, *data[2];
+  struct block_request requests[2];
+  struct block_iovec iov[2];
+  int64_t start;
+  long long bytes = 0;
+  int files = 0;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  data[0] = palloc_get_multiple (0, EXTRACT_PAGES);
+  data[1] = palloc_get_multiple (0, EXTRACT_PAGES);
+  if (header == NULL || data[0] == NULL || data[1] == NULL)
     PANIC ("couldn't allocate buffers");
 
   /* Open source block device. */
@@ -89,6 +122,7 @@ fsutil_extract (char **argv UNUSED)
 
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
+  start = timer_usecs ();
 
   for (;;)
     {
@@ -113,34 +147,57 @@ fsutil_extract (char **argv UNUSED)
       else if (type == USTAR_REGULAR)
         {
           struct file *dst;
+          int chunk_size = 0;
+          int cur = 0;
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
+          /* Create destination file, allocating all of its sectors
+             at once. */
           if (!filesys_create (file_name, size))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, reading the next chunk while writing this one. */
+          if (size > 0)
+            chunk_size = start_extract_read (src, sector, size, data[cur],
+                                             &requests[cur], &iov[cur]);
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
+              int next_size = 0;
+
+              block_wait (&requests[cur]);
+              sector += iov[cur].cnt;
+              if (size > chunk_size)
+                next_size = start_extract_read (src, sector,
+                                                size - chunk_size,
+                                                data[!cur], &requests[!cur],
+                                                &iov[!cur]);
+              if (file_write (dst, data[cur], chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
               size -= chunk_size;
+              bytes += chunk_size;
+              chunk_size = next_size;
+              cur = !cur;
             }
 
           /* Finish up. */
           file_close (dst);
+          files++;
         }
     }
 
+  if (files > 0)
+    {
+      int64_t usecs = timer_usecs () - start;
+      printf ("Extracted %d files, %lld bytes in %lld ms (%lld kB/s)\n",
+              files, bytes, usecs / 1000,
+              usecs > 0 ? bytes * 1000000 / 1024 / usecs : 0);
+    }
+
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
      two blocks because two blocks of zeros are the ustar
@@ -150,7 +207,8 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_multiple (data[0], EXTRACT_PAGES);
+  palloc_free_multiple (data[1], EXTRACT_PAGES);
   free (header);
 }
 
@@ -1,23 +1,86 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Layout of the index in an on-disk inode: direct sectors, then
+   one indirect sector holding PTRS_PER_SECTOR sector numbers, then
+   one doubly indirect sector holding that many indirect sectors. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define SECTOR_CNT (DIRECT_CNT + 2)
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Largest file an inode can index, in bytes: 16,635 sectors, a
+   little over 8 MB.  That is the size of the whole file system
+   partition Pintos uses, so no triply indirect level is kept; a
+   larger partition still holds no file beyond this. */
+#define INODE_MAX_LENGTH ((DIRECT_CNT + PTRS_PER_SECTOR                 \
+                           + PTRS_PER_SECTOR * PTRS_PER_SECTOR)          \
+                          * BLOCK_SECTOR_SIZE)
+
+/* Sectors set aside at once for a growing file.  Data written
+   later is placed in them, so the file stays contiguous on disk. */
+#define PREALLOC_SECTORS 16
+
+/* Reads of at least this many bytes copy whole sectors that are
+   not cached straight from disk, without filling the cache. */
+#define BYPASS_READ_MIN (8 * BLOCK_SECTOR_SIZE)
+
+/* Most sectors that a large write fills for the first time under
+   one journal handle.  They are written around the cache. */
+#define WRITE_RUN_SECTORS 64
+
+/* Most sectors that inode_extend indexes under one journal
+   handle. */
+#define EXTEND_STEP_SECTORS 2048
+
+/* Most runs of sectors given back to the free map under one journal
+   handle when an inode is released.  Each run changes at most two
+   free map sectors. */
+#define RELEASE_STEP 32
+#define RELEASE_STEP_SECTORS (2 * RELEASE_STEP)
+
+/* Marks a hole in the index: the sector was never written and reads
+   as zeros.  Sector 0 holds the free map inode, so it is never a
+   data or index sector. */
+#define NO_SECTOR 0
+
+/* Set in an index entry whose data sector is allocated but was
+   never written.  It reads as zeros, like a hole, and is zeroed
+   by the first write, so that creating a large file does not
+   write all of it. */
+#define UNWRITTEN 0x80000000u
+
+/* How byte_to_sector fills a hole in the index. */
+enum fill_mode
+  {
+    FILL_NONE,                  /* Leave it. */
+    FILL_META,                  /* Allocate a zeroed, logged sector. */
+    FILL_UNWRITTEN,             /* Allocate a sector, mark it UNWRITTEN. */
+    FILL_WRITE                  /* Allocate a sector, or clear
+                                   UNWRITTEN, to be written. */
+  };
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t sectors[SECTOR_CNT]; /* Index, see DIRECT_CNT. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -31,46 +94,277 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers, protected
+                                           by open_inodes_lock. */
+    bool loading;                       /* Being read from disk, protected
+                                           by open_inodes_lock. */
+    struct lock dir_lock;               /* Held by directory operations. */
+
+    /* Protected by LOCK. */
+    struct lock lock;
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct extent prealloc;             /* Reserved for growth, in memory only. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+/* Returns true if the data of the inode in SECTOR, whose on-disk
+   inode is DISK, is metadata, which is logged in the journal:
+   directories and the free map. */
+static bool
+is_meta (block_sector_t sector, const struct inode_disk *disk) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  return disk->is_dir || sector == FREE_MAP_SECTOR;
+}
+
+/* Returns at most how many metadata sectors change when SECTORS
+   sectors are added to an inode: index sectors, free map sectors
+   and, if META, the sectors themselves. */
+static size_t
+growth_cost (size_t sectors, bool meta) 
+{
+  return ((meta ? sectors : 0) + DIV_ROUND_UP (sectors, PTRS_PER_SECTOR) + 2
+          + DIV_ROUND_UP (sectors, BLOCK_SECTOR_SIZE * 8) + 1);
+}
+
+/* Takes a sector from PREALLOC and stores it in *SECTORP, marking
+   it allocated in the free map.  When PREALLOC is used up, a new
+   run of up to PREALLOC_SECTORS is reserved, placed right after
+   the last one if possible; reserved sectors stay free on disk
+   until they are taken, so a crash cannot leak them.  A
+   sector that will hold metadata, as selected by META, is filled
+   with zeros, which are logged.  Any logged copy of a data sector
+   from an earlier use is revoked instead; its contents are left
+   alone.  Returns false if the disk is full.  Must be called
+   inside a journal handle. */
+static bool
+take_sector (struct extent *prealloc, block_sector_t *sectorp, bool meta) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (prealloc->cnt == 0
+      && !free_map_reserve_extent (prealloc->start, PREALLOC_SECTORS,
+                                   prealloc))
+    return false;
+  if (!free_map_claim (prealloc->start))
+    return false;
+  *sectorp = prealloc->start++;
+  prealloc->cnt--;
+  if (meta)
+    cache_write_meta (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
   else
-    return -1;
+    journal_revoke (*sectorp);
+  return true;
+}
+
+/* Gives back the sectors left in PREALLOC.  They were never marked
+   on disk, so no journal handle is needed. */
+static void
+release_prealloc (struct extent *prealloc) 
+{
+  if (prealloc->cnt > 0)
+    free_map_unreserve (prealloc->start, prealloc->cnt);
+  prealloc->cnt = 0;
+}
+
+/* Fills the index entry in *ENTRYP, if it is a hole or unwritten,
+   according to MODE, taking sectors from PREALLOC.  Sets *CHANGED
+   to true if *ENTRYP was modified.  Returns the entry, except that
+   in FILL_WRITE mode a sector that holds no data yet is returned
+   with UNWRITTEN set although the entry no longer has it.  Returns
+   NO_SECTOR if the disk is full. */
+static block_sector_t
+fill_entry (block_sector_t *entryp, struct extent *prealloc,
+            enum fill_mode mode, bool *changed) 
+{
+  block_sector_t sector = *entryp;
+
+  if (mode == FILL_NONE || (sector != NO_SECTOR && !(sector & UNWRITTEN)))
+    return sector;
+  if (sector & UNWRITTEN)
+    {
+      if (mode != FILL_WRITE)
+        return sector;
+      sector &= ~UNWRITTEN;
+    }
+  else if (!take_sector (prealloc, &sector, mode == FILL_META))
+    return NO_SECTOR;
+
+  *changed = true;
+  switch (mode)
+    {
+    case FILL_META:
+      return *entryp = sector;
+    case FILL_UNWRITTEN:
+      return *entryp = sector | UNWRITTEN;
+    case FILL_WRITE:
+      *entryp = sector;
+      return sector | UNWRITTEN;
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Returns entry IDX of index sector INDEX, filled according to
+   MODE like fill_entry.  Returns NO_SECTOR for a hole or if
+   allocation fails. */
+static block_sector_t
+index_lookup (block_sector_t index, off_t idx, struct extent *prealloc,
+              enum fill_mode mode) 
+{
+  block_sector_t entry, sector;
+  size_t ofs = idx * sizeof entry;
+  bool changed = false;
+
+  if (index == NO_SECTOR)
+    return NO_SECTOR;
+  cache_read_at (index, &entry, ofs, sizeof entry);
+  sector = fill_entry (&entry, prealloc, mode, &changed);
+  if (changed)
+    cache_write_meta (index, &entry, ofs, sizeof entry);
+  return sector;
+}
+
+/* Returns entry IDX of DISK's own index, filled like index_lookup.
+   Sets *CHANGED to true if DISK was modified. */
+static block_sector_t
+disk_lookup (struct inode_disk *disk, off_t idx, struct extent *prealloc,
+             enum fill_mode mode, bool *changed) 
+{
+  return fill_entry (&disk->sectors[idx], prealloc, mode, changed);
+}
+
+/* Returns the index entry for the block device sector that
+   contains byte offset POS within DISK, or NO_SECTOR if that part
+   of the file is a hole.  An entry with UNWRITTEN set names a
+   sector that was allocated but never written.  Either reads as
+   zeros.
+   Unless MODE is FILL_NONE, holes on the way are filled with
+   sectors taken from PREALLOC and *CHANGED is set to true if DISK
+   itself was modified; NO_SECTOR is then returned only if the disk
+   is full.  Index sectors are always zeroed, the data sector is
+   filled according to MODE. */
+static block_sector_t
+byte_to_sector (struct inode_disk *disk, off_t pos, struct extent *prealloc,
+                enum fill_mode mode, bool *changed) 
+{
+  enum fill_mode index_mode = mode == FILL_NONE ? FILL_NONE : FILL_META;
+  off_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t index;
+
+  ASSERT (pos >= 0 && pos < INODE_MAX_LENGTH);
+  if (idx < DIRECT_CNT)
+    return disk_lookup (disk, idx, prealloc, mode, changed);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      index = disk_lookup (disk, INDIRECT_IDX, prealloc, index_mode, changed);
+      return index_lookup (index, idx, prealloc, mode);
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  index = disk_lookup (disk, DBL_INDIRECT_IDX, prealloc, index_mode, changed);
+  index = index_lookup (index, idx / PTRS_PER_SECTOR, prealloc, index_mode);
+  return index_lookup (index, idx % PTRS_PER_SECTOR, prealloc, mode);
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Gives CNT sectors starting at SECTOR back to the free map.  After
+   every RELEASE_STEP runs counted in *RELEASED, the journal handle
+   is ended and a new one begun, so that releasing a large inode
+   does not overflow a transaction.  Inside an enclosing handle that
+   changes nothing, which is fine for sectors allocated under the
+   same handle: their free map sectors are logged already. */
+static void
+release_run (block_sector_t sector, size_t cnt, size_t *released) 
+{
+  free_map_release (sector, cnt);
+  if (++*released % RELEASE_STEP == 0)
+    {
+      journal_end ();
+      journal_begin_reserve (RELEASE_STEP_SECTORS);
+    }
+}
+
+/* Releases the sector of index entry ENTRY and, if it is an index
+   sector LEVELS levels above the data, every sector it refers
+   to, counting the runs in *RELEASED like release_run. */
+static void
+release_sectors (block_sector_t entry, int levels, size_t *released) 
+{
+  if (entry == NO_SECTOR)
+    return;
+  if (levels > 0)
+    {
+      off_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_sectors (index_lookup (entry, i, NULL, FILL_NONE),
+                         levels - 1, released);
+    }
+  release_run (entry & ~UNWRITTEN, 1, released);
+}
+
+/* Releases every sector indexed by DISK, counting the runs in
+   *RELEASED like release_run.  Must be called inside a journal
+   handle. */
+static void
+release_index (struct inode_disk *disk, size_t *released) 
+{
+  off_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_sectors (disk->sectors[i], 0, released);
+  release_sectors (disk->sectors[INDIRECT_IDX], 1, released);
+  release_sectors (disk->sectors[DBL_INDIRECT_IDX], 2, released);
+}
+
+/* Open inodes by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+
+/* Protects open_inodes and the open counts of its inodes. */
+static struct lock open_inodes_lock;
+
+/* Signaled when an inode in open_inodes has been read from disk. */
+static struct condition inode_loaded;
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  IS_DIR marks the inode as holding a directory.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory or disk allocation fails.
+   Must be called inside a journal handle that reserved
+   inode_create_cost (LENGTH, IS_DIR) sectors for it. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,63 +375,165 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (length > INODE_MAX_LENGTH)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      struct extent prealloc = { sector + 1, 0 };
+      bool changed = false;
+      bool meta;
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      meta = is_meta (sector, disk_inode);
+
+      success = (sectors == 0
+                 || free_map_reserve_extent (sector + 1, sectors,
+                                             &prealloc));
+      for (i = 0; i < sectors && success; i++)
+        success = (byte_to_sector (disk_inode, i * BLOCK_SECTOR_SIZE,
+                                   &prealloc,
+                                   meta ? FILL_META : FILL_UNWRITTEN,
+                                   &changed) != NO_SECTOR);
+      release_prealloc (&prealloc);
+      if (success)
+        cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      else
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+          size_t released = 0;
+          release_index (disk_inode, &released);
+        }
       free (disk_inode);
     }
   return success;
 }
 
+/* Returns at most how many metadata sectors inode_create changes
+   for an inode LENGTH bytes long. */
+size_t
+inode_create_cost (off_t length, bool is_dir)
+{
+  return growth_cost (bytes_to_sectors (length), is_dir) + 1;
+}
+
+/* Extends data inode INODE to LENGTH bytes, indexing the new
+   sectors as unwritten like inode_create does, for a file too large
+   to be created in one journal transaction.  Each step of
+   EXTEND_STEP_SECTORS sectors has a journal handle of its own, so
+   that after a crash the inode has the length of the last step
+   committed.  Returns true if successful, false if LENGTH is too
+   large or the disk is full, in which case INODE keeps the length
+   it reached.  Must not be called inside a journal handle. */
+bool
+inode_extend (struct inode *inode, off_t length) 
+{
+  bool success = true;
+
+  ASSERT (!is_meta (inode->sector, &inode->data));
+  if (length > INODE_MAX_LENGTH)
+    return false;
+
+  while (success && inode_length (inode) < length)
+    {
+      struct extent prealloc = { inode->sector + 1, 0 };
+      bool changed = false;
+      size_t first, end, i;
+
+      journal_begin_reserve (growth_cost (EXTEND_STEP_SECTORS, false) + 1);
+      lock_acquire (&inode->lock);
+      first = bytes_to_sectors (inode->data.length);
+      end = bytes_to_sectors (length);
+      if (end - first > EXTEND_STEP_SECTORS)
+        end = first + EXTEND_STEP_SECTORS;
+
+      /* Place the new sectors after the last one. */
+      if (first > 0)
+        prealloc.start = (byte_to_sector (&inode->data,
+                                          (first - 1) * BLOCK_SECTOR_SIZE,
+                                          NULL, FILL_NONE, NULL)
+                          & ~UNWRITTEN) + 1;
+      if (end > first)
+        success = free_map_reserve_extent (prealloc.start, end - first,
+                                           &prealloc);
+      for (i = first; i < end && success; i++)
+        success = (byte_to_sector (&inode->data, i * BLOCK_SECTOR_SIZE,
+                                   &prealloc, FILL_UNWRITTEN, &changed)
+                   != NO_SECTOR);
+      release_prealloc (&prealloc);
+
+      if (success && inode->data.length < length)
+        {
+          off_t end_ofs = end * BLOCK_SECTOR_SIZE;
+          inode->data.length = end_ofs < length ? end_ofs : length;
+          changed = true;
+        }
+      if (changed)
+        cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      lock_release (&inode->lock);
+      journal_end ();
+    }
+  return success;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails.
+   The inode is read without holding open_inodes_lock; anyone
+   opening it meanwhile waits until it has been read. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is marked as loading until it has been
+     read, so that nobody else uses it half initialized. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  inode->loading = true;
+  lock_init (&inode->dir_lock);
+  lock_init (&inode->lock);
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->prealloc.start = sector + 1;
+  inode->prealloc.cnt = 0;
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +542,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -157,28 +557,60 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  int open_cnt;
+
+  lock_acquire (&open_inodes_lock);
+  open_cnt = inode->open_cnt;
+  lock_release (&open_inodes_lock);
+  return open_cnt;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, frees its blocks, under as
+   many journal handles as that takes.  A crash part way leaks the
+   rest, as the inode is no longer linked anywhere.  Closing the
+   last reference to a removed inode must therefore not be done
+   inside a journal handle. */
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
+      release_prealloc (&inode->prealloc);
+
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          size_t released = 0;
+
+          journal_begin_reserve (RELEASE_STEP_SECTORS);
+          release_run (inode->sector, 1, &released);
+          release_index (&inode->data, &released);
+          journal_end ();
         }
 
       free (inode); 
@@ -191,88 +623,257 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
+}
+
+/* Acquires the lock that serializes changes to and lookups in the
+   directory held by INODE. */
+void
+inode_lock_dir (struct inode *inode) 
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock taken by inode_lock_dir. */
+void
+inode_unlock_dir (struct inode *inode) 
+{
+  lock_release (&inode->dir_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   INODE's lock is only held to find each sector, so readers and
+   writers of different parts of a file run in parallel.
+   Large reads bypass the cache for whole sectors it does not hold,
+   which go from disk straight into BUFFER. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool bypass = size >= BYPASS_READ_MIN;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int min_left;
 
       /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
+      int chunk_size;
+      block_sector_t sector_idx = NO_SECTOR;
+
+      lock_acquire (&inode->lock);
+      inode_left = inode->data.length - offset;
+      min_left = inode_left < sector_left ? inode_left : sector_left;
+      chunk_size = size < min_left ? size : min_left;
+      if (chunk_size > 0)
+        sector_idx = byte_to_sector (&inode->data, offset, NULL, FILL_NONE,
+                                     NULL);
+      lock_release (&inode->lock);
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy the chunk out of the cached sector, a hole or an
+         unwritten sector reads as zeros. */
+      if (sector_idx == NO_SECTOR || (sector_idx & UNWRITTEN))
+        memset (buffer + bytes_read, 0, chunk_size);
+      else if (bypass && chunk_size == BLOCK_SECTOR_SIZE)
+        cache_read_bypass (sector_idx, buffer + bytes_read);
+      else
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Queues the sectors holding SIZE bytes of INODE starting at
+   OFFSET to be read into the cache in the background.  Bytes past
+   the end of INODE are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+
+  lock_acquire (&inode->lock);
+  if (end > inode->data.length)
+    end = inode->data.length;
+  offset = offset / BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE;
+  for (; offset < end; offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (&inode->data, offset,
+                                              NULL, FILL_NONE, NULL);
+      if (sector != NO_SECTOR && !(sector & UNWRITTEN))
+        cache_read_ahead (sector);
+    }
+  lock_release (&inode->lock);
+}
+
+/* Writes SIZE bytes from BUFFER at byte SECTOR_OFS of the sector
+   of INODE that holds byte POS.  A hole is allocated first, and
+   the allocation, the index changes and the rewritten inode are
+   logged together as one journal handle.  The first write to a
+   data sector fills the rest of it with zeros and is made with
+   INODE's lock held, so that readers never see what the sector
+   held before it was allocated, and it is ordered before the
+   handle's transaction commits, so that nobody does after a
+   crash either.  Returns false if the disk is
+   full. */
+static bool
+write_sector (struct inode *inode, const void *buffer, off_t pos,
+              int sector_ofs, int size, bool meta) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t sector;
+  bool changed = false;
+  bool written = false;
+
+  lock_acquire (&inode->lock);
+  sector = byte_to_sector (&inode->data, pos, NULL, FILL_NONE, NULL);
+  lock_release (&inode->lock);
+
+  if (sector == NO_SECTOR || (sector & UNWRITTEN))
+    {
+      journal_begin ();
+      lock_acquire (&inode->lock);
+      sector = byte_to_sector (&inode->data, pos, &inode->prealloc,
+                               meta ? FILL_META : FILL_WRITE, &changed);
+      if (changed)
+        cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      if (sector != NO_SECTOR && (sector & UNWRITTEN))
+        {
+          sector &= ~UNWRITTEN;
+          if (size < BLOCK_SECTOR_SIZE)
+            cache_write (sector, zeros);
+          cache_write_at (sector, buffer, sector_ofs, size);
+          if (!meta)
+            journal_order ();
+          written = true;
+        }
+      lock_release (&inode->lock);
+      journal_end ();
+      if (sector == NO_SECTOR || written)
+        return written;
+    }
+
+  /* Copy the chunk into the cached sector, which is only read from
+     disk first if the chunk does not cover all of it. */
+  if (meta)
+    cache_write_meta (sector, buffer, sector_ofs, size);
+  else
+    cache_write_at (sector, buffer, sector_ofs, size);
+  return true;
+}
+
+/* Writes up to CNT whole sectors from BUFFER into data inode INODE,
+   starting at POS, a multiple of BLOCK_SECTOR_SIZE, as long as they
+   have never been written.  Holes in the run are allocated as
+   unwritten sectors first, so readers keep seeing zeros, and the
+   data goes straight to disk around the cache, without INODE's lock,
+   before the sectors are marked written.  All of it is done under
+   one journal handle, whose transaction thus commits only once the
+   data is home.  Returns the number of sectors written, which is 0
+   if the first sector was written before, and less than CNT at the
+   first sector that was, or if the disk is full. */
+static size_t
+write_run (struct inode *inode, const uint8_t *buffer, off_t pos, size_t cnt)
+{
+  block_sector_t sectors[WRITE_RUN_SECTORS];
+  bool changed = false;
+  size_t run, i;
+
+  if (cnt > WRITE_RUN_SECTORS)
+    cnt = WRITE_RUN_SECTORS;
+
+  lock_acquire (&inode->lock);
+  sectors[0] = byte_to_sector (&inode->data, pos, NULL, FILL_NONE, NULL);
+  lock_release (&inode->lock);
+  if (sectors[0] != NO_SECTOR && !(sectors[0] & UNWRITTEN))
+    return 0;
+
+  journal_begin_reserve (growth_cost (cnt, false) + 1);
+  lock_acquire (&inode->lock);
+  for (run = 0; run < cnt; run++)
+    {
+      off_t ofs = pos + run * BLOCK_SECTOR_SIZE;
+      block_sector_t sector = byte_to_sector (&inode->data, ofs, NULL,
+                                              FILL_NONE, NULL);
+      if (sector != NO_SECTOR && !(sector & UNWRITTEN))
+        break;
+      if (sector == NO_SECTOR)
+        sector = byte_to_sector (&inode->data, ofs, &inode->prealloc,
+                                 FILL_UNWRITTEN, &changed);
+      if (sector == NO_SECTOR)
+        break;
+      sectors[run] = sector & ~UNWRITTEN;
+    }
+  lock_release (&inode->lock);
+
+  for (i = 0; i < run; i++)
+    cache_write_bypass (sectors[i], buffer + i * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&inode->lock);
+  for (i = 0; i < run; i++)
+    byte_to_sector (&inode->data, pos + i * BLOCK_SECTOR_SIZE,
+                    &inode->prealloc, FILL_WRITE, &changed);
+  if (changed)
+    cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&inode->lock);
+  journal_end ();
+  return run;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Writing past end of file extends INODE, and any gap between the
+   old end and OFFSET is left as a hole that reads as zeros.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full, the maximum file size is
+   reached or an error occurs.
+   INODE's lock is held while sectors are found or allocated and
+   while the length is updated, but not while data is copied,
+   except for the first write to a sector.  Large writes fill
+   runs of new sectors under a single handle, straight to disk.  The
+   new length is set only after the data is in place, so a reader
+   never sees the zeroed sectors of a growing file.
+   Writes to a directory or the free map are metadata and must be
+   made inside a journal handle, which logs them. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool meta = is_meta (inode->sector, &inode->data);
 
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
+  lock_release (&inode->lock);
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left before the maximum file size, bytes left in
+         sector, lesser of the two. */
+      off_t inode_left = INODE_MAX_LENGTH - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,38 +882,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
+      /* Fill whole new sectors a run at a time. */
+      if (!meta && chunk_size == BLOCK_SECTOR_SIZE
+          && size >= 2 * BLOCK_SECTOR_SIZE)
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          off_t run_left = size < inode_left ? size : inode_left;
+          size_t run = write_run (inode, buffer + bytes_written, offset,
+                                  run_left / BLOCK_SECTOR_SIZE);
+          if (run > 0)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              size -= run * BLOCK_SECTOR_SIZE;
+              offset += run * BLOCK_SECTOR_SIZE;
+              bytes_written += run * BLOCK_SECTOR_SIZE;
+              continue;
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
         }
+      if (!write_sector (inode, buffer + bytes_written, offset,
+                         sector_ofs, chunk_size, meta))
+        break;
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (bytes_written > 0 && offset > inode_length (inode))
+    {
+      journal_begin ();
+      lock_acquire (&inode->lock);
+      if (offset > inode->data.length)
+        {
+          inode->data.length = offset;
+          cache_write_meta (inode->sector, &inode->data, 0,
+                            BLOCK_SECTOR_SIZE);
+        }
+      lock_release (&inode->lock);
+      journal_end ();
+    }
 
   return bytes_written;
 }
@@ -322,8 +929,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,12 +941,15 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Reading it does
+   not need INODE's lock: writers update it with one store. */
 off_t
 inode_length (const struct inode *inode)
 {
@@ -0,0 +1,720 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Metadata changes are made atomic with a write-ahead log.
+
+   Every change to a metadata sector (inodes, index sectors,
+   directories and the free map) happens inside a handle, between
+   journal_begin and journal_end, and the new contents of the sector
+   are copied into the running transaction by journal_log.  The
+   buffer cache never writes such a sector home itself.  Handles are
+   grouped: the running transaction collects every handle started
+   since the last commit and is committed as a whole, once a second
+   or when it fills up, by writing it to the log with one
+   sequential run of writes.
+
+   A transaction in the log is one or more descriptor sectors
+   listing its sectors, a copy of each sector and finally a commit
+   sector.  Committed sectors are only written to their home
+   locations when the log runs out of space, at the checkpoint,
+   which also advances the sequence number in the journal header so
+   that the transactions in the log become stale.  After a crash,
+   journal_init replays every complete transaction found in the log.
+
+   A sector that held metadata and is freed may be reused for file
+   data, which is not logged.  Allocating it for data revokes its
+   logged copies, so that neither a checkpoint nor a replay writes
+   them over the data.
+
+   File data is not logged, but it is ordered: a transaction that
+   gives a file a sector holding no data yet, and writes the data,
+   flushes the buffer cache before its commit sector is written.
+   Otherwise a crash could leave the file indexing a sector whose
+   old contents, maybe those of a deleted file, never got
+   overwritten. */
+
+/* Identify journal sectors. */
+#define HEADER_MAGIC 0x4a4e4c48
+#define DESC_MAGIC 0x4a4e4c44
+#define COMMIT_MAGIC 0x4a4e4c43
+
+/* How often the running transaction is committed. */
+#define JOURNAL_COMMIT_TICKS TIMER_FREQ
+
+/* Marks a revoked sector in a descriptor.  No copy follows. */
+#define REVOKED 0x80000000u
+
+/* Journal header, in sector JOURNAL_SECTOR. */
+struct journal_header
+  {
+    uint32_t magic;                     /* HEADER_MAGIC. */
+    uint32_t seq;                       /* First transaction in the log. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 2 * sizeof (uint32_t)];
+  };
+
+/* Number of sectors listed in one descriptor. */
+#define DESC_ENTRIES ((BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t))        \
+                      / sizeof (block_sector_t))
+
+/* Descriptor sector.  A transaction with ENTRY_CNT entries starts
+   with DIV_ROUND_UP (ENTRY_CNT, DESC_ENTRIES) of them. */
+struct journal_desc
+  {
+    uint32_t magic;                     /* DESC_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t entry_cnt;                 /* Entries in the transaction. */
+    block_sector_t sectors[DESC_ENTRIES]; /* Home sectors, maybe REVOKED. */
+  };
+
+/* Commit sector, ending a transaction. */
+struct journal_commit
+  {
+    uint32_t magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t entry_cnt;                 /* Entries in the transaction. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+  };
+
+/* A version of a metadata sector logged by transaction SEQ, or a
+   revocation of SECTOR if REVOKED is set in the running
+   transaction.  A revoked committed version is not checkpointed. */
+struct journal_block
+  {
+    struct hash_elem hash_elem;         /* In blocks, if the newest. */
+    struct list_elem list_elem;         /* In running or committed. */
+    block_sector_t sector;              /* Home sector. */
+    uint32_t seq;                       /* Transaction. */
+    bool revoked;                       /* Must not be written home. */
+    struct journal_block *older;        /* Previous version, if logged. */
+    uint8_t *data;                      /* Sector contents. */
+  };
+
+/* Protects everything below.  Acquired after a cache entry's lock,
+   never before. */
+static struct lock journal_lock;
+
+static struct hash blocks;      /* Newest version of each sector. */
+static struct list running;     /* Blocks of the running transaction. */
+static struct list committed;   /* Committed, not checkpointed blocks. */
+static uint32_t running_seq;    /* Sequence number of running. */
+static size_t running_cnt;      /* Copies in running, not revocations. */
+static size_t reserved;         /* Reservations of handles in progress. */
+static int active;              /* Handles in progress. */
+static bool committing;         /* A commit or checkpoint in progress. */
+static bool running_ordered;    /* Running wrote data, see journal_order. */
+static size_t log_pos;          /* Next free sector of the log. */
+static struct condition idle;   /* Signaled when ACTIVE drops to 0. */
+static struct condition commit_done; /* Signaled when COMMITTING clears. */
+
+static void checkpoint (void);
+static void write_header (uint32_t seq);
+static void replay (void);
+static thread_func commit_thread NO_RETURN;
+
+/* Returns a hash value for block E. */
+static unsigned
+block_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct journal_block, hash_elem)->sector);
+}
+
+/* Returns true if block A precedes block B. */
+static bool
+block_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct journal_block, hash_elem)->sector
+          < hash_entry (b, struct journal_block, hash_elem)->sector);
+}
+
+/* Returns the newest logged version of SECTOR, or a null pointer.
+   journal_lock must be held. */
+static struct journal_block *
+find_block (block_sector_t sector)
+{
+  struct journal_block key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&blocks, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct journal_block, hash_elem) : NULL;
+}
+
+/* Adds a new version of SECTOR to the running transaction, older
+   than nothing else logged.  journal_lock must be held. */
+static struct journal_block *
+new_block (block_sector_t sector, struct journal_block *older)
+{
+  struct journal_block *b = malloc (sizeof *b);
+  if (b == NULL || (b->data = malloc (BLOCK_SECTOR_SIZE)) == NULL)
+    PANIC ("out of memory for the journal");
+  b->sector = sector;
+  b->seq = running_seq;
+  b->revoked = false;
+  b->older = older;
+  list_push_back (&running, &b->list_elem);
+  return b;
+}
+
+/* Frees block B. */
+static void
+free_block (struct journal_block *b)
+{
+  free (b->data);
+  free (b);
+}
+
+/* Returns the number of log sectors taken by a transaction of
+   ENTRY_CNT entries, BLOCK_CNT of which are copies. */
+static size_t
+txn_sectors (size_t entry_cnt, size_t block_cnt)
+{
+  return DIV_ROUND_UP (entry_cnt, DESC_ENTRIES) + block_cnt + 1;
+}
+
+/* Returns the device sector of log sector POS. */
+static block_sector_t
+log_sector (size_t pos)
+{
+  return JOURNAL_SECTOR + 1 + pos;
+}
+
+/* Initializes the journal.  If FORMAT is true the log is emptied,
+   otherwise the transactions committed to it before the last
+   shutdown or crash are replayed.  Must be called before anything
+   is read from the file system device. */
+void
+journal_init (bool format)
+{
+  /* Descriptors are written as an array of consecutive sectors. */
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  hash_init (&blocks, block_hash, block_less, NULL);
+  list_init (&running);
+  list_init (&committed);
+  cond_init (&idle);
+  cond_init (&commit_done);
+  log_pos = 0;
+
+  if (format)
+    {
+      running_seq = 1;
+      write_header (running_seq);
+    }
+  else
+    replay ();
+  thread_create ("journal", PRI_DEFAULT, commit_thread, NULL);
+}
+
+/* Commits the running transaction and checkpoints the log, leaving
+   every metadata sector at home. */
+void
+journal_done (void)
+{
+  journal_commit ();
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_done, &journal_lock);
+  committing = true;
+  lock_release (&journal_lock);
+
+  checkpoint ();
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Starts a handle: the metadata changes made until the matching
+   journal_end are committed together or not at all.  Handles nest;
+   only the outermost one counts.  The outermost handle must be
+   started before any file system lock is acquired, because it may
+   wait for the running transaction to be committed. */
+void
+journal_begin (void)
+{
+  journal_begin_reserve (JOURNAL_HANDLE_SECTORS);
+}
+
+/* Starts a handle like journal_begin, reserving SECTOR_CNT sectors
+   of the running transaction for it, which are enough for any
+   handle nested in it as well.  Returns false, without starting a
+   handle, if SECTOR_CNT sectors never fit in a transaction.  A
+   nested handle reserves nothing: its outermost handle must have
+   reserved for it. */
+bool
+journal_begin_reserve (size_t sector_cnt)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth > 0)
+    {
+      t->journal_depth++;
+      return true;
+    }
+  if (sector_cnt > JOURNAL_TXN_MAX)
+    return false;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&commit_done, &journal_lock);
+      else if (running_cnt + reserved + sector_cnt > JOURNAL_TXN_MAX)
+        {
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+      else
+        break;
+    }
+  reserved += sector_cnt;
+  active++;
+  lock_release (&journal_lock);
+
+  t->journal_reserved = sector_cnt;
+  t->journal_depth = 1;
+  return true;
+}
+
+/* Ends a handle started by journal_begin. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_reserved;
+  if (--active == 0)
+    cond_broadcast (&idle, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes the running transaction to the log, first waiting for the
+   handles in progress to end.  If another thread is committing
+   already, waits for it instead.  Must not be called inside a
+   handle. */
+void
+journal_commit (void)
+{
+  struct journal_desc *descs;
+  struct journal_commit *commit;
+  struct block_iovec *iov;
+  struct list_elem *e;
+  size_t entry_cnt, desc_cnt, sectors, iov_cnt, i;
+
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  if (committing)
+    {
+      while (committing)
+        cond_wait (&commit_done, &journal_lock);
+      lock_release (&journal_lock);
+      return;
+    }
+  committing = true;
+  while (active > 0)
+    cond_wait (&idle, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* Nothing below changes while COMMITTING is set and no handle is
+     active, so the log is written without holding journal_lock. */
+  entry_cnt = list_size (&running);
+  if (entry_cnt == 0)
+    goto done;
+  sectors = txn_sectors (entry_cnt, running_cnt);
+  if (sectors > JOURNAL_SIZE)
+    PANIC ("journal transaction of %zu sectors overflows the log",
+           sectors);
+  if (log_pos + sectors > JOURNAL_SIZE)
+    checkpoint ();
+
+  /* The descriptors and the copies go to the log in one request.
+     The commit sector follows in a second one, so that it cannot
+     reach the disk before them. */
+  desc_cnt = DIV_ROUND_UP (entry_cnt, DESC_ENTRIES);
+  descs = calloc (desc_cnt, sizeof *descs);
+  commit = calloc (1, sizeof *commit);
+  iov = malloc ((running_cnt + 1) * sizeof *iov);
+  if (descs == NULL || commit == NULL || iov == NULL)
+    PANIC ("out of memory for the journal");
+  iov[0].buffer = descs;
+  iov[0].cnt = desc_cnt;
+  iov_cnt = 1;
+  i = 0;
+  for (e = list_begin (&running); e != list_end (&running);
+       e = list_next (e))
+    {
+      struct journal_block *b = list_entry (e, struct journal_block,
+                                            list_elem);
+      struct journal_desc *desc = &descs[i / DESC_ENTRIES];
+
+      desc->magic = DESC_MAGIC;
+      desc->seq = running_seq;
+      desc->entry_cnt = entry_cnt;
+      desc->sectors[i++ % DESC_ENTRIES] = (b->sector
+                                           | (b->revoked ? REVOKED : 0));
+      if (!b->revoked)
+        {
+          iov[iov_cnt].buffer = b->data;
+          iov[iov_cnt].cnt = 1;
+          iov_cnt++;
+        }
+    }
+  block_write_multi (fs_device, log_sector (log_pos), iov, iov_cnt);
+  commit->magic = COMMIT_MAGIC;
+  commit->seq = running_seq;
+  commit->entry_cnt = entry_cnt;
+  if (running_ordered)
+    cache_flush ();
+  block_write (fs_device, log_sector (log_pos + sectors - 1), commit);
+  free_map_commit ();
+  free (iov);
+  free (descs);
+  free (commit);
+
+  lock_acquire (&journal_lock);
+  while (!list_empty (&running))
+    {
+      struct journal_block *b = list_entry (list_pop_front (&running),
+                                            struct journal_block, list_elem);
+      if (b->revoked)
+        free_block (b);
+      else
+        list_push_back (&committed, &b->list_elem);
+    }
+  running_seq++;
+  running_cnt = 0;
+  running_ordered = false;
+  log_pos += sectors;
+  lock_release (&journal_lock);
+
+ done:
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Notes that the running transaction made a file index a sector
+   that held no data of the file yet and wrote the data in the
+   buffer cache, so that the data is written home before the
+   transaction commits.  Must be called inside a handle. */
+void
+journal_order (void)
+{
+  ASSERT (thread_current ()->journal_depth > 0);
+  lock_acquire (&journal_lock);
+  running_ordered = true;
+  lock_release (&journal_lock);
+}
+
+/* Logs DATA as the new contents of metadata sector SECTOR in the
+   running transaction.  Must be called inside a handle. */
+void
+journal_log (block_sector_t sector, const void *data)
+{
+  struct journal_block *b;
+
+  ASSERT (thread_current ()->journal_depth > 0);
+  lock_acquire (&journal_lock);
+  b = find_block (sector);
+  if (b == NULL || b->seq != running_seq)
+    {
+      b = new_block (sector, b);
+      hash_replace (&blocks, &b->hash_elem);
+      running_cnt++;
+    }
+  memcpy (b->data, data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* Reads sector SECTOR into BUFFER: its newest logged version if it
+   has one, otherwise the sector on disk. */
+void
+journal_read (block_sector_t sector, void *buffer)
+{
+  struct journal_block *b;
+
+  lock_acquire (&journal_lock);
+  b = find_block (sector);
+  if (b != NULL)
+    memcpy (buffer, b->data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+  if (b == NULL)
+    block_read (fs_device, sector, buffer);
+}
+
+/* Forgets the logged versions of SECTOR, which is being reused for
+   file data.  Must be called inside a handle. */
+void
+journal_revoke (block_sector_t sector)
+{
+  struct journal_block *b, *older;
+  bool in_log = false;
+
+  ASSERT (thread_current ()->journal_depth > 0);
+  lock_acquire (&journal_lock);
+  b = find_block (sector);
+  if (b != NULL)
+    {
+      hash_delete (&blocks, &b->hash_elem);
+      for (older = b; older != NULL; older = older->older)
+        if (older->seq != running_seq)
+          {
+            older->revoked = true;
+            in_log = true;
+          }
+
+      /* Versions already in the log need a revocation record, or a
+         replay would bring them back. */
+      if (b->seq == running_seq)
+        {
+          running_cnt--;
+          if (in_log)
+            b->revoked = true;
+          else
+            {
+              list_remove (&b->list_elem);
+              free_block (b);
+            }
+        }
+      else
+        new_block (sector, NULL)->revoked = true;
+    }
+  lock_release (&journal_lock);
+}
+
+/* Writes every committed sector home and empties the log.  Must be
+   called with COMMITTING set and no handle active. */
+static void
+checkpoint (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&committed); e != list_end (&committed);
+       e = list_next (e))
+    {
+      struct journal_block *b = list_entry (e, struct journal_block,
+                                            list_elem);
+      if (!b->revoked)
+        block_write (fs_device, b->sector, b->data);
+    }
+  write_header (running_seq);
+
+  lock_acquire (&journal_lock);
+  while (!list_empty (&committed))
+    {
+      struct journal_block *b = list_entry (list_pop_front (&committed),
+                                            struct journal_block, list_elem);
+      if (find_block (b->sector) == b)
+        hash_delete (&blocks, &b->hash_elem);
+      free_block (b);
+    }
+  for (e = list_begin (&running); e != list_end (&running);
+       e = list_next (e))
+    list_entry (e, struct journal_block, list_elem)->older = NULL;
+  log_pos = 0;
+  lock_release (&journal_lock);
+}
+
+/* Writes the journal header, saying that the log starts with
+   transaction SEQ. */
+static void
+write_header (uint32_t seq)
+{
+  struct journal_header *h = calloc (1, sizeof *h);
+  if (h == NULL)
+    PANIC ("out of memory for the journal");
+  h->magic = HEADER_MAGIC;
+  h->seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, h);
+  free (h);
+}
+
+/* A sector revoked during replay. */
+struct revocation
+  {
+    struct hash_elem elem;
+    block_sector_t sector;
+    uint32_t seq;                       /* Last transaction revoking it. */
+  };
+
+/* Returns a hash value for revocation E. */
+static unsigned
+revocation_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct revocation, elem)->sector);
+}
+
+/* Returns true if revocation A precedes revocation B. */
+static bool
+revocation_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct revocation, elem)->sector
+          < hash_entry (b, struct revocation, elem)->sector);
+}
+
+/* Frees revocation E. */
+static void
+revocation_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct revocation, elem));
+}
+
+/* Looks for a complete transaction SEQ at log sector POS, using
+   BUF and DESC as scratch space.  If there is none, returns 0.
+   Otherwise, returns its length in sectors and, if APPLY is false,
+   records its revocations in REVOKED, or if APPLY is true, writes
+   each copy home unless its sector is revoked by a later
+   transaction. */
+static size_t
+replay_txn (size_t pos, uint32_t seq, bool apply, struct hash *revoked,
+            struct journal_desc *desc, void *buf)
+{
+  struct journal_commit *commit = buf;
+  size_t entry_cnt, desc_cnt, block_cnt, i;
+  size_t data_pos;
+
+  /* Count the copies to find the commit sector. */
+  block_read (fs_device, log_sector (pos), desc);
+  if (desc->magic != DESC_MAGIC || desc->seq != seq)
+    return 0;
+  entry_cnt = desc->entry_cnt;
+  desc_cnt = DIV_ROUND_UP (entry_cnt, DESC_ENTRIES);
+  if (entry_cnt == 0 || pos + desc_cnt >= JOURNAL_SIZE)
+    return 0;
+  block_cnt = 0;
+  for (i = 0; i < entry_cnt; i++)
+    {
+      if (i % DESC_ENTRIES == 0)
+        {
+          block_read (fs_device, log_sector (pos + i / DESC_ENTRIES), desc);
+          if (desc->magic != DESC_MAGIC || desc->seq != seq)
+            return 0;
+        }
+      if (!(desc->sectors[i % DESC_ENTRIES] & REVOKED))
+        block_cnt++;
+    }
+  if (pos + txn_sectors (entry_cnt, block_cnt) > JOURNAL_SIZE)
+    return 0;
+  block_read (fs_device, log_sector (pos + desc_cnt + block_cnt), commit);
+  if (commit->magic != COMMIT_MAGIC || commit->seq != seq
+      || commit->entry_cnt != entry_cnt)
+    return 0;
+
+  data_pos = pos + desc_cnt;
+  for (i = 0; i < entry_cnt; i++)
+    {
+      block_sector_t sector;
+      struct revocation key, *r;
+      struct hash_elem *e;
+
+      if (i % DESC_ENTRIES == 0)
+        block_read (fs_device, log_sector (pos + i / DESC_ENTRIES), desc);
+      sector = desc->sectors[i % DESC_ENTRIES] & ~REVOKED;
+      key.sector = sector;
+      e = hash_find (revoked, &key.elem);
+      r = e != NULL ? hash_entry (e, struct revocation, elem) : NULL;
+
+      if (desc->sectors[i % DESC_ENTRIES] & REVOKED)
+        {
+          if (apply)
+            continue;
+          if (r == NULL)
+            {
+              r = malloc (sizeof *r);
+              if (r == NULL)
+                PANIC ("out of memory replaying the journal");
+              r->sector = sector;
+              hash_insert (revoked, &r->elem);
+            }
+          r->seq = seq;
+        }
+      else
+        {
+          if (apply && (r == NULL || r->seq <= seq))
+            {
+              block_read (fs_device, log_sector (data_pos), buf);
+              block_write (fs_device, sector, buf);
+            }
+          data_pos++;
+        }
+    }
+  return txn_sectors (entry_cnt, block_cnt);
+}
+
+/* Replays the complete transactions in the log, then empties it. */
+static void
+replay (void)
+{
+  struct journal_header *h = malloc (sizeof *h);
+  struct journal_desc *desc = malloc (sizeof *desc);
+  struct hash revoked;
+  uint32_t first, seq;
+  size_t pos, len;
+
+  if (h == NULL || desc == NULL)
+    PANIC ("out of memory replaying the journal");
+  block_read (fs_device, JOURNAL_SECTOR, h);
+  if (h->magic != HEADER_MAGIC)
+    PANIC ("file system has no journal, reformat it");
+  first = h->seq;
+
+  /* Find the revocations first, since they cancel copies logged
+     before them. */
+  hash_init (&revoked, revocation_hash, revocation_less, NULL);
+  for (pos = 0, seq = first;
+       (len = replay_txn (pos, seq, false, &revoked, desc, h)) > 0;
+       pos += len, seq++)
+    continue;
+  if (seq != first)
+    {
+      printf ("journal: replaying %"PRIu32" transactions\n", seq - first);
+      for (pos = 0, seq = first;
+           (len = replay_txn (pos, seq, true, &revoked, desc, h)) > 0;
+           pos += len, seq++)
+        continue;
+    }
+  hash_destroy (&revoked, revocation_free);
+  free (desc);
+  free (h);
+
+  running_seq = seq;
+  write_header (running_seq);
+}
+
+/* Commits the running transaction every JOURNAL_COMMIT_TICKS, so
+   that a crash loses at most that much of the metadata changes. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (JOURNAL_COMMIT_TICKS);
+      journal_commit ();
+    }
+}
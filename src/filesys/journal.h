@@ -0,0 +1,35 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Sectors of the on-disk log, which follows the journal header in
+   sector JOURNAL_SECTOR. */
+#define JOURNAL_SIZE 256
+
+/* Most sectors in the running transaction, counting the
+   reservations of the handles in progress. */
+#define JOURNAL_TXN_MAX 128
+
+/* Metadata sectors reserved by journal_begin.  A handle that may
+   change more than this starts with journal_begin_reserve. */
+#define JOURNAL_HANDLE_SECTORS 16
+
+void journal_init (bool format);
+void journal_done (void);
+
+/* Grouping metadata updates into atomic operations. */
+void journal_begin (void);
+bool journal_begin_reserve (size_t sector_cnt);
+void journal_end (void);
+void journal_commit (void);
+
+/* Called by the buffer cache and the inode layer. */
+void journal_log (block_sector_t, const void *);
+void journal_order (void);
+void journal_read (block_sector_t, void *);
+void journal_revoke (block_sector_t);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,47 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+#include <stdint.h>
+
+/* Buckets in each histogram of struct block_stats.  Bucket 0
+   counts values of 0 and bucket I > 0 those from 2**(I-1) up to
+   2**I - 1, except that the last bucket also counts all larger
+   values. */
+#define BLOCK_STATS_BUCKETS 24
+
+/* Statistics that the kernel keeps for a block device from boot
+   on, printed at shutdown and returned by blockstats().  Times are
+   in microseconds.  A request is a block_read, block_write or
+   similar call; a dispatch is one transfer by the driver, which
+   may carry out several requests to consecutive sectors. */
+struct block_stats
+  {
+    uint64_t time;                      /* When these were taken. */
+
+    uint64_t read_cnt;                  /* Sectors read. */
+    uint64_t write_cnt;                 /* Sectors written. */
+    uint64_t read_requests;             /* Read requests. */
+    uint64_t write_requests;            /* Write requests. */
+    uint64_t size_hist[BLOCK_STATS_BUCKETS]; /* Requests by sectors. */
+
+    /* Completed requests by time from submission to completion. */
+    uint64_t read_latency[BLOCK_STATS_BUCKETS];
+    uint64_t write_latency[BLOCK_STATS_BUCKETS];
+    uint64_t wait_time;                 /* Total time queued. */
+
+    uint64_t dispatches;                /* Transfers by the driver. */
+    uint64_t service_time;              /* Total time transferring. */
+    uint64_t seek_total;                /* Total sectors between the end
+                                           of one dispatch and the start
+                                           of the next. */
+    uint64_t seek_hist[BLOCK_STATS_BUCKETS]; /* Dispatches by those
+                                           sectors. */
+
+    uint32_t depth;                     /* Requests not yet completed. */
+    uint32_t max_depth;                 /* Most at any time. */
+    uint64_t depth_time;                /* DEPTH summed over time, which
+                                           divided by TIME is the average
+                                           queue depth. */
+  };
+
+#endif /* lib/block-stats.h */
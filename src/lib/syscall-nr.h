@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Memory mapping extensions. */
+    SYS_MSYNC,                  /* Write a memory mapping back to its file. */
+    SYS_MADVISE,                /* Give usage advice for a memory mapping. */
+
+    /* Block device statistics. */
+    SYS_BLOCKSTATS              /* Read a block device's I/O statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -1,5 +1,9 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
+#include "../vdso.h"
+
+/* The read-only page the kernel maps into every process. */
+#define vdso ((const struct vdso_data *) VDSO_BASE)
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
@@ -153,6 +157,18 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+int
+msync (mapid_t mapid, int flags)
+{
+  return syscall2 (SYS_MSYNC, mapid, flags);
+}
+
+int
+madvise (mapid_t mapid, int advice)
+{
+  return syscall2 (SYS_MADVISE, mapid, advice);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -182,3 +198,37 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int64_t
+get_ticks (void)
+{
+  uint32_t seq;
+  int64_t ticks;
+
+  /* Retry if the timer interrupt updated the ticks in between. */
+  do
+    {
+      seq = vdso->seq;
+      ticks = vdso->ticks;
+    }
+  while ((seq & 1) != 0 || seq != vdso->seq);
+  return ticks;
+}
+
+pid_t
+getpid (void)
+{
+  return vdso->pid;
+}
+
+unsigned long
+get_boot_time (void)
+{
+  return vdso->boot_time;
+}
+
+bool
+blockstats (const char *device, struct block_stats *stats)
+{
+  return syscall2 (SYS_BLOCKSTATS, device, stats);
+}
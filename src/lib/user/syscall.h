@@ -2,7 +2,9 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
+#include "../block-stats.h"
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,6 +14,16 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for msync(). */
+#define MS_SYNC 0               /* Write back before returning. */
+#define MS_ASYNC 1              /* Start write back and return. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_SEQUENTIAL 1       /* Expect sequential access, read ahead. */
+#define MADV_WILLNEED 2         /* Expect access soon, load now. */
+#define MADV_DONTNEED 3         /* Do not expect access, write back and drop. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -37,6 +49,8 @@ void close (int fd);
 /* Task 3 and optionally task 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+int msync (mapid_t, int flags);
+int madvise (mapid_t, int advice);
 
 /* Task 4 only. */
 bool chdir (const char *dir);
@@ -45,4 +59,12 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Block device statistics. */
+bool blockstats (const char *device, struct block_stats *);
+
+/* Read from the page shared with the kernel, without a trap. */
+int64_t get_ticks (void);
+pid_t getpid (void);
+unsigned long get_boot_time (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,23 @@
+#ifndef __LIB_VDSO_H
+#define __LIB_VDSO_H
+
+#include <stdint.h>
+
+/* User virtual address of the read-only page the kernel maps into
+   every process, the page just below the 8 MB reserved for the
+   stack. */
+#define VDSO_BASE 0xbf7ff000
+
+/* Layout of the shared page.  The kernel updates TICKS from the
+   timer interrupt while the process may be reading it, so SEQ is
+   made odd around each update: a reader retries until it sees the
+   same even SEQ before and after reading TICKS. */
+struct vdso_data
+  {
+    volatile uint32_t seq;      /* Odd while TICKS is being updated. */
+    volatile int64_t ticks;     /* Timer ticks since the OS booted. */
+    int pid;                    /* Pid of the process. */
+    unsigned long boot_time;    /* Seconds since the Unix epoch at boot. */
+  };
+
+#endif /* lib/vdso.h */
@@ -0,0 +1,52 @@
+/* Reads the I/O statistics of the file system device, which has
+   been read at least to load this program, and checks that they
+   are consistent and only ever grow. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct block_stats before, after;
+
+/* Returns the sum of the buckets of histogram HIST. */
+static uint64_t
+hist_sum (const uint64_t hist[BLOCK_STATS_BUCKETS]) 
+{
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < BLOCK_STATS_BUCKETS; i++)
+    sum += hist[i];
+  return sum;
+}
+
+void
+test_main (void) 
+{
+  CHECK (blockstats ("filesys", &before), "blockstats \"filesys\"");
+  CHECK (!blockstats ("no-such-device", &before),
+         "blockstats \"no-such-device\" (must fail)");
+  CHECK (blockstats ("filesys", &before), "blockstats \"filesys\" again");
+
+  if (before.read_cnt == 0 || before.read_requests == 0)
+    fail ("no reads counted");
+  if (hist_sum (before.size_hist)
+      != before.read_requests + before.write_requests)
+    fail ("request size histogram does not add up");
+  if (hist_sum (before.read_latency) > before.read_requests
+      || hist_sum (before.write_latency) > before.write_requests)
+    fail ("more requests completed than submitted");
+  if (hist_sum (before.seek_hist) != before.dispatches)
+    fail ("seek histogram does not add up");
+  msg ("statistics are consistent");
+
+  CHECK (create ("stats", 4096), "create \"stats\"");
+  CHECK (blockstats ("filesys", &after), "blockstats \"filesys\" after create");
+  if (after.time < before.time
+      || after.read_requests < before.read_requests
+      || after.write_requests < before.write_requests
+      || after.dispatches < before.dispatches
+      || after.depth_time < before.depth_time)
+    fail ("statistics went back");
+  msg ("statistics only grow");
+}
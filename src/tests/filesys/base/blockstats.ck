@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blockstats) begin
+(blockstats) blockstats "filesys"
+(blockstats) blockstats "no-such-device" (must fail)
+(blockstats) blockstats "filesys" again
+(blockstats) statistics are consistent
+(blockstats) create "stats"
+(blockstats) blockstats "filesys" after create
+(blockstats) statistics only grow
+(blockstats) end
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Creates enough files in a subdirectory to make it grow well past
+   64 buckets, about 1,200 entries, then finds each of them by an
+   absolute path, counts them with readdir and checks that the
+   non-empty directory cannot be removed. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 2000
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  char path[32];
+  int cnt;
+  int fd;
+  int i;
+
+  CHECK (mkdir ("many"), "mkdir \"many\"");
+  CHECK (chdir ("many"), "chdir \"many\"");
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("open each file by absolute path");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (path, sizeof path, "/many/f%d", i);
+      fd = open (path);
+      if (fd < 2)
+        fail ("open \"%s\" failed", path);
+      if (isdir (fd))
+        fail ("\"%s\" is a directory", path);
+      close (fd);
+    }
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  CHECK (isdir (fd), "isdir \".\"");
+  cnt = 0;
+  while (readdir (fd, name))
+    cnt++;
+  CHECK (cnt == FILE_CNT, "readdir found %d entries", FILE_CNT);
+  close (fd);
+
+  CHECK (chdir (".."), "chdir \"..\"");
+  CHECK (!remove ("many"), "remove non-empty \"many\" (must fail)");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) mkdir "many"
+(dir-many) chdir "many"
+(dir-many) create 2000 files
+(dir-many) open each file by absolute path
+(dir-many) open "."
+(dir-many) isdir "."
+(dir-many) readdir found 2000 entries
+(dir-many) chdir ".."
+(dir-many) remove non-empty "many" (must fail)
+(dir-many) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Grows an empty file by writing well past its end, beyond the
+   direct sectors of the inode, and checks that the skipped part
+   reads back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOLE_SIZE 70000
+
+static char buf[512];
+
+void
+test_main (void) 
+{
+  const char *data = "0123456789";
+  size_t data_len = strlen (data);
+  size_t ofs;
+  int fd;
+
+  CHECK (create ("sparse", 0), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  seek (fd, HOLE_SIZE);
+  CHECK (write (fd, data, data_len) == (int) data_len,
+         "write past end of \"sparse\"");
+  CHECK (filesize (fd) == HOLE_SIZE + (int) data_len,
+         "filesize of \"sparse\" is %d", HOLE_SIZE + (int) data_len);
+
+  msg ("verify hole in \"sparse\"");
+  seek (fd, 0);
+  for (ofs = 0; ofs < HOLE_SIZE; ofs += sizeof buf) 
+    {
+      size_t block_size = HOLE_SIZE - ofs < sizeof buf
+                          ? HOLE_SIZE - ofs : sizeof buf;
+      size_t i;
+
+      if (read (fd, buf, block_size) != (int) block_size)
+        fail ("read %zu bytes at offset %zu failed", block_size, ofs);
+      for (i = 0; i < block_size; i++)
+        if (buf[i] != 0)
+          fail ("byte %zu of \"sparse\" is %d, not zero", ofs + i, buf[i]);
+    }
+
+  CHECK (read (fd, buf, sizeof buf) == (int) data_len,
+         "read data of \"sparse\"");
+  if (memcmp (buf, data, data_len))
+    fail ("data read back from \"sparse\" differs");
+  msg ("close \"sparse\"");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse) begin
+(grow-sparse) create "sparse"
+(grow-sparse) open "sparse"
+(grow-sparse) write past end of "sparse"
+(grow-sparse) filesize of "sparse" is 70010
+(grow-sparse) verify hole in "sparse"
+(grow-sparse) read data of "sparse"
+(grow-sparse) close "sparse"
+(grow-sparse) end
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Reads the ticks, pid and boot time from the page the kernel
+   shares with every process, and checks that the ticks advance
+   without any system call being made. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int64_t start = get_ticks ();
+  int64_t now = start;
+
+  CHECK (start >= 0, "read ticks");
+  CHECK (getpid () > 0, "read pid");
+  CHECK (get_boot_time () > 0, "read boot time");
+  while (now == start)
+    {
+      int64_t next = get_ticks ();
+      if (next < now)
+        fail ("ticks went back from %lld to %lld", now, next);
+      now = next;
+    }
+  msg ("ticks advance");
+}
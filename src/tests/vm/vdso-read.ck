@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vdso-read) begin
+(vdso-read) read ticks
+(vdso-read) read pid
+(vdso-read) read boot time
+(vdso-read) ticks advance
+(vdso-read) end
+EOF
+pass;
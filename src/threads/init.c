@@ -34,10 +34,12 @@
 #ifdef VM
 #include "devices/swap.h"
 #include "vm/frame.h"
+#include "vm/region.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -56,6 +58,9 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of the RAM disk to create in kB, if positive. */
+static int ramdisk_kb;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -127,6 +132,8 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  if (ramdisk_kb > 0)
+    ramdisk_init (ramdisk_kb);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -135,6 +142,7 @@ main (void)
   /* Initialise the swap disk */  
   swap_init ();
   frame_init ();
+  region_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -261,6 +269,8 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
@@ -386,6 +396,8 @@ usage (void)
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
+          "  -ramdisk=SIZE      Create RAM disk ram0 of SIZE kB, e.g. for\n"
+          "                     use as BDEV in the options above.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
@@ -402,16 +414,37 @@ static void
 locate_block_devices (void)
 {
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
-  locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
   locate_block_device (BLOCK_SWAP, swap_bdev_name);
 #endif
+  locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
+}
+
+/* Returns true if BLOCK shares a controller channel with a block
+   device already cast in a role. */
+static bool
+shares_channel (struct block *block)
+{
+  int channel = block_channel (block);
+  enum block_type role;
+
+  if (channel == BLOCK_NO_CHANNEL)
+    return false;
+  for (role = 0; role < BLOCK_ROLE_CNT; role++)
+    {
+      struct block *other = block_get_role (role);
+      if (other != NULL && other != block && block_channel (other) == channel)
+        return true;
+    }
+  return false;
 }
 
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the first block device in probe order of type ROLE
+   that does not share a channel with another role's device, so
+   that the roles do not wait for each other, or failing that the
+   first of type ROLE. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
@@ -425,9 +458,19 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
-      for (block = block_first (); block != NULL; block = block_next (block))
-        if (block_type (block) == role)
-          break;
+      struct block *b;
+
+      for (b = block_first (); b != NULL; b = block_next (b))
+        if (block_type (b) == role)
+          {
+            if (block == NULL)
+              block = b;
+            if (!shares_channel (b))
+              {
+                block = b;
+                break;
+              }
+          }
     }
 
   if (block != NULL)
@@ -100,7 +100,6 @@ thread_init (void)
 #ifdef USERPROG
   lock_init (&child_lock);
   sema_init (&execute_sema, 0);
-  lock_init (&file_lock);
   lock_init(&page_lock);
 #endif
 
@@ -151,7 +150,10 @@ thread_tick (void)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      user_ticks++;
+      process_vdso_tick ();
+    }
 #endif
   else
     kernel_ticks++;
@@ -510,6 +512,7 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->magic = THREAD_MAGIC;
+  list_init (&t->region_list);
 #ifdef USERPROG
   list_init (&t->child_list);
   t->parent_status = false;
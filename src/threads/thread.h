@@ -27,8 +27,6 @@ typedef int tid_t;
 #define PRI_MAX 63                      /* Highest priority. */
 
 #ifdef USERPROG
-/* set a global lock for file system */
-struct lock file_lock;
 /* lock used for deletion and generation of child*/
 struct lock child_lock;
 /* lock used for lock pages while using */
@@ -108,6 +106,7 @@ struct thread
     struct list_elem elem;              /* List element. */
     struct hash supplemental_page_table; /* supplemental page table */
     int stack_size;                     /* the size of stack */
+    void *user_esp;                     /* user stack pointer saved on syscall entry */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -122,9 +121,16 @@ struct thread
     struct file *executable_file;      /* represent the executable */
     int *exit_code;                    /* the pointer to exit code */
     struct semaphore *wait_sema;       /* origin 0 will be up when exit */
+    struct vdso_data *vdso;            /* page shared read only with the process */
+#endif
+#ifdef FILESYS
+    struct dir *cwd;                   /* current directory, null for the root */
+    int journal_depth;                 /* nesting of journal handles */
+    size_t journal_reserved;           /* sectors reserved by the handle */
 #endif
    struct hash mmap_hash;              /* hash storing mmap created */
    int map_int;                        /* map_int used for record map id*/
+   struct list region_list;            /* file backed regions sorted by address */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -11,6 +11,7 @@
 #include <string.h>
 #include "vm/frame.h"
 #include "vm/pageTable.h"
+#include "vm/region.h"
 #include "threads/thread.h"
 #include "filesys/file.h"
 #include "userprog/process.h"
@@ -166,9 +167,15 @@ page_fault(struct intr_frame *f)
   lock_acquire(&page_lock);
 
   struct page_elem *page = page_lookup((uint32_t)pg_round_down(fault_addr));
+  /* pages of file backed regions only get an entry on first access */
+  if (page == NULL)
+  {
+    page = region_materialize((uint32_t)pg_round_down(fault_addr));
+  }
 
-  /* check if it is a stack access */
-  void *esp = f->esp;
+  /* check if it is a stack access, a fault taken in the kernel does not
+     save esp so use the one saved on syscall entry */
+  void *esp = user ? f->esp : thread_current()->user_esp;
   if (page == NULL && is_stack_address(fault_addr, esp))
   {
     /* grow the stack */
@@ -199,6 +206,7 @@ page_fault(struct intr_frame *f)
     default: // for both mmap and file
       /* if the lock is not released when coming to interrupt */
       load_page(page->lazy_file, page);
+      region_read_ahead(page);
       lock_release(&page_lock);
       break;
     }
@@ -208,6 +216,15 @@ page_fault(struct intr_frame *f)
   /* Count page faults. */
   page_fault_cnt++;
 
+  /* a kernel access to a bad user address comes from get_user or
+     put_user in syscall.c, which left the address to resume at in eax */
+  if (!user && is_user_vaddr(fault_addr))
+  {
+    f->eip = (void (*)(void))f->eax;
+    f->eax = 0xffffffff;
+    return;
+  }
+
   /* check if the memory is unmapped */
   if (!is_valid_ptr(fault_addr))
   {
@@ -299,12 +316,9 @@ void load_page(struct lazy_file *Lfile, struct page_elem *page)
     }
   }
   /* Load data into the page. */
-  lock_acquire(&file_lock);
   if (file_read_at(Lfile->file, kpage, Lfile->read_bytes, Lfile->offset) != (int)Lfile->read_bytes)
   {
-    lock_release(&file_lock);
     PANIC("load page failed\n");
   }
-  lock_release(&file_lock);
   memset(kpage + Lfile->read_bytes, 0, Lfile->zero_bytes);
 }
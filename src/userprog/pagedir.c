@@ -9,6 +9,7 @@
 #include "vm/frame.h"
 
 static uint32_t *active_pd (void);
+static bool map_page (uint32_t *pd, void *upage, void *kpage, bool writable);
 static void invalidate_pagedir (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
@@ -99,6 +100,30 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
    failed. */
 bool
 pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  if (!map_page (pd, upage, kpage, writable))
+    return false;
+  /* add element to our own page table */
+  frame_add((uint32_t) kpage, page_lookup((uint32_t) upage));
+  return true;
+}
+
+/* Like pagedir_set_page, but for a page that is not backed by a
+   frame of the process, such as the page shared with the kernel.
+   It is not added to the frame table, so it is never evicted, and
+   the caller must clear the mapping and free KPAGE itself before
+   PD is destroyed. */
+bool
+pagedir_set_shared_page (uint32_t *pd, void *upage, void *kpage,
+                         bool writable)
+{
+  return map_page (pd, upage, kpage, writable);
+}
+
+/* Maps UPAGE to KPAGE in PD, for pagedir_set_page and
+   pagedir_set_shared_page. */
+static bool
+map_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 {
   uint32_t *pte;
 
@@ -114,8 +139,6 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     {
       ASSERT ((*pte & PTE_P) == 0);
       *pte = pte_create_user (kpage, writable);
-      /* add element to our own page table */
-      frame_add((uint32_t) kpage, page_lookup((uint32_t) upage));
       return true;
     }
   else
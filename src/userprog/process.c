@@ -18,9 +18,14 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "devices/rtc.h"
+#include "devices/timer.h"
 #include "vm/pageTable.h"
+#include <vdso.h>
+#include "vm/region.h"
 
 static bool exists; /* use for indicate whether executable file exists */
+static time_t boot_time; /* seconds since the epoch at boot, set on first load */
 static thread_func start_process NO_RETURN;
 static bool load(const char *, void (**eip)(void), void **);
 static void free_child_list(struct list *);
@@ -29,6 +34,7 @@ struct arg_para
 {
   char *cpointer;
   char *file_name;
+  struct dir *cwd; /* current directory of the parent */
 };
 
 /* Starts a new thread running a user program loaded from
@@ -66,6 +72,7 @@ tid_t process_execute(const char *cmd_line)
   struct arg_para create_para;
   create_para.cpointer = cpointer;
   create_para.file_name = file_name;
+  create_para.cwd = thread_current()->cwd;
 
   /* Create a new thread to execute FILE_NAME. */
   lock_acquire(&child_lock);
@@ -105,6 +112,13 @@ start_process(void *create_para)
   char *cpointer = ((struct arg_para *)create_para)->cpointer;
   char *token = file_name;
 
+  /* the parent waits for the load, so its directory is still open */
+  struct dir *parent_cwd = ((struct arg_para *)create_para)->cwd;
+  if (parent_cwd != NULL)
+  {
+    cur->cwd = dir_reopen(parent_cwd);
+  }
+
   struct intr_frame if_;
   bool success;
 
@@ -126,11 +140,9 @@ start_process(void *create_para)
   }
 
   /* deny write when execute this file */
-  lock_acquire(&file_lock);
   struct file *executable_file = filesys_open(file_name);
   cur->executable_file = executable_file;
   file_deny_write(executable_file);
-  lock_release(&file_lock);
 
   /* address we stored is 32 bit */
   uint8_t **_esp = (uint8_t **)&if_.esp;
@@ -256,16 +268,17 @@ void process_exit(void)
   struct thread *cur = thread_current();
   uint32_t *pd;
   /* allow write to executable file after process terminates */
-  lock_acquire(&file_lock);
   if (cur->executable_file != NULL)
   {
     file_close(cur->executable_file);
   }
   hash_destroy(&cur->file_table, free_struct_file);
-  lock_release(&file_lock);
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
   lock_acquire(&page_lock);
   hash_destroy(&cur->mmap_hash, munmapHelper);
   hash_destroy(&cur->supplemental_page_table, page_free_action);
+  region_destroy_all();
   lock_release(&page_lock);
   free_child_list(&thread_current()->child_list);
 
@@ -274,6 +287,10 @@ void process_exit(void)
   pd = cur->pagedir;
   if (pd != NULL)
   {
+    /* stop the timer interrupt from writing the shared page before it
+       is freed below */
+    struct vdso_data *vdso = cur->vdso;
+    cur->vdso = NULL;
     /* Correct ordering here is crucial.  We must set
        cur->pagedir to NULL before switching page directories,
        so that a timer interrupt can't switch back to the
@@ -283,6 +300,11 @@ void process_exit(void)
        that's been freed (and cleared). */
     cur->pagedir = NULL;
     pagedir_activate(NULL);
+    if (vdso != NULL)
+    {
+      pagedir_clear_page(pd, (void *)VDSO_BASE);
+      palloc_free_page(vdso);
+    }
     pagedir_destroy(pd);
   }
 }
@@ -297,6 +319,10 @@ void process_activate(void)
   /* Activate thread's page tables. */
   pagedir_activate(t->pagedir);
 
+  /* the shared page of a process is only written while it runs, catch
+     up on the ticks that passed while it was switched out */
+  process_vdso_tick();
+
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update();
@@ -366,6 +392,7 @@ struct Elf32_Phdr
 #define PF_R 4 /* Readable. */
 
 static bool setup_stack(void **esp);
+static bool setup_vdso(void);
 static bool validate_segment(const struct Elf32_Phdr *, struct file *);
 static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
                          uint32_t read_bytes, uint32_t zero_bytes,
@@ -391,9 +418,7 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   process_activate();
 
   /* Open executable file. */
-  lock_acquire(&file_lock);
   file = filesys_open(file_name);
-  lock_release(&file_lock);
   if (file == NULL)
   {
     printf("load: %s: open failed\n", file_name);
@@ -401,13 +426,11 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   }
 
   /* Read and verify executable header. */
-  lock_acquire(&file_lock);
   if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr || memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 || ehdr.e_machine != 3 || ehdr.e_version != 1 || ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024)
   {
     printf("load: %s: error loading executable\n", file_name);
     goto done;
   }
-  lock_release(&file_lock);
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++)
@@ -416,14 +439,11 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
 
     if (file_ofs < 0 || file_ofs > file_length(file))
       goto done;
-    lock_acquire(&file_lock);
     file_seek(file, file_ofs);
     if (file_read(file, &phdr, sizeof phdr) != sizeof phdr)
     {
-      lock_release(&file_lock);
       goto done;
     }
-    lock_release(&file_lock);
     file_ofs += sizeof phdr;
     switch (phdr.p_type)
     {
@@ -474,6 +494,10 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
   if (!setup_stack(esp))
     goto done;
 
+  /* Map the page shared with the kernel. */
+  if (!setup_vdso())
+    goto done;
+
   /* Start address. */
   *eip = (void (*)(void))ehdr.e_entry;
 
@@ -482,9 +506,7 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
 done:
   if (!success)
   {
-    lock_acquire(&file_lock);
     file_close(file);
-    lock_release(&file_lock);
   }
   return success;
 }
@@ -522,6 +544,10 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
   if (phdr->p_vaddr + phdr->p_memsz < phdr->p_vaddr)
     return false;
 
+  /* The region must not overlap the page shared with the kernel. */
+  if (phdr->p_vaddr < VDSO_BASE + PGSIZE && phdr->p_vaddr + phdr->p_memsz > VDSO_BASE)
+    return false;
+
   /* Disallow mapping page 0.
      Not only is it a bad idea to map page 0, but if we allowed
      it then user code that passed a null pointer to system calls
@@ -546,8 +572,11 @@ validate_segment(const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Only a single region descriptor is recorded here, the page
+   entries are created by the page fault handler on first access.
+
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs. */
 static bool
 load_segment(struct file *file, off_t ofs, uint8_t *upage,
              uint32_t read_bytes, uint32_t zero_bytes, bool writable)
@@ -555,48 +584,13 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
   ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
-  lock_acquire(&file_lock);
-  file_seek(file, ofs);
-  lock_release(&file_lock);
-  while (read_bytes > 0 || zero_bytes > 0)
-  {
-    /* Calculate how to fill this page.
-       We will read PAGE_READ_BYTES bytes from FILE
-       and zero the final PAGE_ZERO_BYTES bytes. */
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-    size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-    lock_acquire(&page_lock);
-    /* doing lazy load */
-    if (page_lookup((uint32_t)upage) == NULL)
-    {
-      page_table_adding((uint32_t)upage, (uint32_t)NULL, IN_FILE);
-    }
-
-    /* clear its own pagedir if it have so it will falls into page fault*/
-    if (pagedir_get_page(thread_current()->pagedir, upage) != NULL)
-    {
-      pagedir_clear_page(thread_current()->pagedir, upage);
-    }
 
-    struct page_elem *page = page_lookup((uint32_t)upage);
-    lock_release(&page_lock);
-    page->page_status = IN_FILE;
-
-    page->lazy_file = malloc(sizeof(struct lazy_file));
-    page->lazy_file->file = file;
-    page->lazy_file->offset = ofs;
-    page->lazy_file->read_bytes = page_read_bytes;
-    page->lazy_file->zero_bytes = page_zero_bytes;
-    page->writable = writable;
-    page->swapped_id = -1;
-    ofs += page_read_bytes;
-    /* Advance. */
-    read_bytes -= page_read_bytes;
-    zero_bytes -= page_zero_bytes;
-    upage += PGSIZE;
-  }
-  return true;
+  lock_acquire(&page_lock);
+  struct region *region = region_add((uint32_t)upage, read_bytes + zero_bytes,
+                                     file, ofs, read_bytes, writable,
+                                     REGION_SEGMENT);
+  lock_release(&page_lock);
+  return region != NULL;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -625,6 +619,51 @@ setup_stack(void **esp)
   return success;
 }
 
+/* Map the read only page holding the ticks, pid and boot time at
+   VDSO_BASE. It comes from the kernel pool and has neither a supplemental
+   page entry nor a frame, so it is never evicted. process_exit unmaps and
+   frees it. */
+static bool
+setup_vdso(void)
+{
+  struct thread *cur = thread_current();
+  struct vdso_data *vdso = palloc_get_page(PAL_ZERO);
+  if (vdso == NULL)
+  {
+    return false;
+  }
+  if (pagedir_get_page(cur->pagedir, (void *)VDSO_BASE) != NULL
+      || !pagedir_set_shared_page(cur->pagedir, (void *)VDSO_BASE, vdso, false))
+  {
+    palloc_free_page(vdso);
+    return false;
+  }
+  if (boot_time == 0)
+  {
+    boot_time = rtc_get_time() - timer_ticks() / TIMER_FREQ;
+  }
+  vdso->pid = cur->tid;
+  vdso->boot_time = boot_time;
+  cur->vdso = vdso;
+  process_vdso_tick();
+  return true;
+}
+
+/* Copy the current ticks into the shared page of the running process.
+   Called from the timer interrupt and on every context switch. */
+void process_vdso_tick(void)
+{
+  struct vdso_data *vdso = thread_current()->vdso;
+  if (vdso != NULL)
+  {
+    enum intr_level old_level = intr_disable();
+    vdso->seq++;
+    vdso->ticks = timer_ticks();
+    vdso->seq++;
+    intr_set_level(old_level);
+  }
+}
+
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -13,6 +13,7 @@ tid_t process_execute(const char *file_name);
 int process_wait(tid_t);
 void process_exit(void);
 void process_activate(void);
+void process_vdso_tick(void);
 
 /* load() helpers. */
 bool install_page(void *upage, void *kpage, bool writable);
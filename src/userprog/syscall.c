@@ -7,6 +7,9 @@
 #include "threads/thread.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "devices/block.h"
 #include "devices/input.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -14,45 +17,83 @@
 #include "devices/shutdown.h"
 #include "userprog/process.h"
 #include <inttypes.h>
+#include <round.h>
+#include <string.h>
 #include "vm/pageTable.h"
 #include "vm/frame.h"
+#include "vm/region.h"
 #include "threads/palloc.h"
 #include "userprog/exception.h"
+#include <vdso.h>
 
 static void syscall_handler(struct intr_frame *f);
-static void syscall_halt(struct intr_frame *f);
-static void syscall_exit(struct intr_frame *f);
-static void syscall_exec(struct intr_frame *f);
-static void syscall_wait(struct intr_frame *f);
-static void syscall_create(struct intr_frame *f);
-static void syscall_remove(struct intr_frame *f);
-static void syscall_open(struct intr_frame *f);
-static void syscall_filesize(struct intr_frame *f);
-static void syscall_read(struct intr_frame *f);
-static void syscall_write(struct intr_frame *f);
-static void syscall_seek(struct intr_frame *f);
-static void syscall_tell(struct intr_frame *f);
-static void syscall_close(struct intr_frame *f);
-static void syscall_mmap(struct intr_frame *f);
-static void syscall_unmmap(struct intr_frame *f);
-
-static void (*fun_ptr_arr[])(struct intr_frame *f) =
+static void syscall_halt(struct intr_frame *f, const uint32_t *args);
+static void syscall_exit(struct intr_frame *f, const uint32_t *args);
+static void syscall_exec(struct intr_frame *f, const uint32_t *args);
+static void syscall_wait(struct intr_frame *f, const uint32_t *args);
+static void syscall_create(struct intr_frame *f, const uint32_t *args);
+static void syscall_remove(struct intr_frame *f, const uint32_t *args);
+static void syscall_open(struct intr_frame *f, const uint32_t *args);
+static void syscall_filesize(struct intr_frame *f, const uint32_t *args);
+static void syscall_read(struct intr_frame *f, const uint32_t *args);
+static void syscall_write(struct intr_frame *f, const uint32_t *args);
+static void syscall_seek(struct intr_frame *f, const uint32_t *args);
+static void syscall_tell(struct intr_frame *f, const uint32_t *args);
+static void syscall_close(struct intr_frame *f, const uint32_t *args);
+static void syscall_mmap(struct intr_frame *f, const uint32_t *args);
+static void syscall_unmmap(struct intr_frame *f, const uint32_t *args);
+static void syscall_msync(struct intr_frame *f, const uint32_t *args);
+static void syscall_madvise(struct intr_frame *f, const uint32_t *args);
+static void syscall_chdir(struct intr_frame *f, const uint32_t *args);
+static void syscall_mkdir(struct intr_frame *f, const uint32_t *args);
+static void syscall_readdir(struct intr_frame *f, const uint32_t *args);
+static void syscall_isdir(struct intr_frame *f, const uint32_t *args);
+static void syscall_inumber(struct intr_frame *f, const uint32_t *args);
+static void syscall_blockstats(struct intr_frame *f, const uint32_t *args);
+
+/* handler of each system call and the number of argument words it takes
+   from the user stack, system calls without a handler are left NULL */
+static const struct syscall_entry
+{
+  void (*handler)(struct intr_frame *f, const uint32_t *args);
+  size_t argc;
+} syscall_table[] =
     {
-        syscall_halt, syscall_exit, syscall_exec, syscall_wait, syscall_create,
-        syscall_remove, syscall_open, syscall_filesize, syscall_read, syscall_write,
-        syscall_seek, syscall_tell, syscall_close, syscall_mmap, syscall_unmmap};
+        [SYS_HALT] = {syscall_halt, 0}, [SYS_EXIT] = {syscall_exit, 1},
+        [SYS_EXEC] = {syscall_exec, 1}, [SYS_WAIT] = {syscall_wait, 1},
+        [SYS_CREATE] = {syscall_create, 2}, [SYS_REMOVE] = {syscall_remove, 1},
+        [SYS_OPEN] = {syscall_open, 1}, [SYS_FILESIZE] = {syscall_filesize, 1},
+        [SYS_READ] = {syscall_read, 3}, [SYS_WRITE] = {syscall_write, 3},
+        [SYS_SEEK] = {syscall_seek, 2}, [SYS_TELL] = {syscall_tell, 1},
+        [SYS_CLOSE] = {syscall_close, 1}, [SYS_MMAP] = {syscall_mmap, 2},
+        [SYS_MUNMAP] = {syscall_unmmap, 1}, [SYS_MSYNC] = {syscall_msync, 2},
+        [SYS_MADVISE] = {syscall_madvise, 2}, [SYS_CHDIR] = {syscall_chdir, 1},
+        [SYS_MKDIR] = {syscall_mkdir, 1}, [SYS_READDIR] = {syscall_readdir, 2},
+        [SYS_ISDIR] = {syscall_isdir, 1}, [SYS_INUMBER] = {syscall_inumber, 1},
+        [SYS_BLOCKSTATS] = {syscall_blockstats, 2}};
 
 static struct File_info *get_file_info(int fd);
+static struct mmap_elem *get_mmap_elem(int mapid);
 
-/* Three functions used for checking user memory access safety. */
-static void check_validation(void *);
-static void check_validation_rw(void *, unsigned);
-static void check_validation_str(char **vaddr);
+/* Function used for fetching the system call number and arguments. */
+static bool fetch_syscall_args(const void *esp, uint32_t *block);
 
-/* function used for pin and unpin frame */
-static void pin_frame(void *uaddr);
-static void unpin_frame(void *uaddr);
-static void unpin_frame_file(void *uaddr, int size);
+/* Functions used for copying between user and kernel memory, a bad user
+   address is reported through the page fault handler's recovery path. */
+static int get_user(const uint8_t *uaddr);
+static bool put_user(uint8_t *udst, uint8_t byte);
+static bool is_user_range(const void *uaddr, size_t size);
+static bool copy_from_user(void *kdst, const void *usrc, size_t size);
+static bool copy_to_user(void *udst, const void *ksrc, size_t size);
+static char *copy_in_string(const char *ustr);
+
+/* Reads and writes of at least this many bytes in one user page go
+   straight to or from the pinned page, smaller ones through a buffer of
+   this size on the kernel stack, see syscall_read. */
+#define DIRECT_IO_MIN 128
+
+static bool pin_user_page(uint8_t *uaddr, bool write, uint8_t **kpagep);
+static void unpin_user_page(uint8_t *uaddr, bool written);
 
 /* function used on mmap and unmmap */
 static bool load_mmap(struct file *file, uint32_t upage, struct mmap_elem *mmap_elem);
@@ -83,6 +124,7 @@ void free_struct_file(struct hash_elem *element, void *aux UNUSED)
 {
   struct File_info *info = GET_FILE(element);
   file_close(info->file);
+  dir_close(info->dir);
   free(info);
 }
 
@@ -100,22 +142,23 @@ void syscall_init(void)
 
 /* direct to related system call according to system call number */
 static void
-syscall_handler(struct intr_frame *f UNUSED)
+syscall_handler(struct intr_frame *f)
 {
-  /* retrieve the system call number */
-  check_validation(ESP);
-  uint32_t syscall_num = *((int *)ESP);
-  unpin_frame(ESP);
-  if (syscall_num >= sizeof(fun_ptr_arr) / sizeof(fun_ptr_arr[0]))
+  /* page faults in the kernel on user addresses need the user stack */
+  thread_current()->user_esp = f->esp;
+  /* the system call number followed by its arguments */
+  uint32_t block[1 + SYSCALL_MAX_ARGS];
+  if (!fetch_syscall_args(f->esp, block))
   {
     terminate_thread(STATUS_FAIL);
   }
-  fun_ptr_arr[syscall_num](f);
+  uint32_t syscall_num = block[0];
+  syscall_table[syscall_num].handler(f, block + 1);
 }
 
 /* Terminates Pintos (this should be seldom used). */
 static void
-syscall_halt(struct intr_frame *f UNUSED)
+syscall_halt(struct intr_frame *f UNUSED, const uint32_t *args UNUSED)
 {
   shutdown_power_off();
 }
@@ -123,25 +166,18 @@ syscall_halt(struct intr_frame *f UNUSED)
 /* Terminates the current user program, sending its
    exit status to the kernal. */
 static void
-syscall_exit(struct intr_frame *f)
+syscall_exit(struct intr_frame *f UNUSED, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  int status = *((int *)(ARG_0));
+  int status = (int)args[0];
 
   struct thread *cur = thread_current();
   printf("%s: exit(%" PRId32 ")\n", cur->name, status);
-  /* ensure the file lock has been released */
-  if (file_lock.holder == cur)
-  {
-    lock_release(&file_lock);
-  }
   if (cur->parent_status == false && cur->child_status_pointer != NULL)
   {
     *(cur->child_status_pointer) = true;
     *(cur->exit_code) = status;
     sema_up(cur->wait_sema);
   }
-  unpin_frame(ARG_0);
   thread_exit();
   NOT_REACHED();
 }
@@ -149,72 +185,79 @@ syscall_exit(struct intr_frame *f)
 /* Runs the executable whose name is given in cmd line, passing any given
    arguments, and returns the new process’s program id (pid). */
 static void
-syscall_exec(struct intr_frame *f)
+syscall_exec(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation_str(ARG_0);
-  char *cmd_line = *(char **)(ARG_0);
+  char *cmd_line = copy_in_string((char *)args[0]);
+  if (cmd_line == NULL)
+  {
+    f->eax = PID_ERROR;
+    return;
+  }
 
   pid_t pid = process_execute(cmd_line);
-  unpin_frame(ARG_0);
+  palloc_free_page(cmd_line);
   f->eax = pid;
 }
 
 /* Waits for a child process pid and retrieves the child’s exit status. */
 static void
-syscall_wait(struct intr_frame *f)
+syscall_wait(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  pid_t pid = *((pid_t *)(ARG_0));
+  pid_t pid = (pid_t)args[0];
 
   int status = process_wait(pid);
-  unpin_frame(ARG_0);
   f->eax = status;
 }
 
 /* Creates a new ﬁle called ﬁle initially initial size bytes in size. */
 static void
-syscall_create(struct intr_frame *f)
+syscall_create(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation_str(ARG_0);
-  check_validation(ARG_1);
-  char *file = *(char **)(ARG_0);
-  unsigned initial_size = *((unsigned *)(ARG_1));
+  char *file = copy_in_string((char *)args[0]);
+  unsigned initial_size = (unsigned)args[1];
+  if (file == NULL)
+  {
+    f->eax = false;
+    return;
+  }
 
-  lock_acquire(&file_lock);
   bool success = filesys_create(file, initial_size);
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
-  unpin_frame(ARG_1);
+  palloc_free_page(file);
   f->eax = success;
 }
 
 /* Deletes the ﬁle called ﬁle. Returns true if successful, false otherwise. */
 static void
-syscall_remove(struct intr_frame *f)
+syscall_remove(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation_str(ARG_0);
-  char *file = *(char **)(ARG_0);
+  char *file = copy_in_string((char *)args[0]);
+  if (file == NULL)
+  {
+    f->eax = false;
+    return;
+  }
 
-  lock_acquire(&file_lock);
   bool success = filesys_remove(file);
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
+  palloc_free_page(file);
   f->eax = success;
 }
 
 /* Opens the ﬁle called ﬁle. Returns a nonnegative integer handle called a
   “ﬁle descriptor” (fd), or -1 if the ﬁle could not be opened. */
 static void
-syscall_open(struct intr_frame *f)
+syscall_open(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation_str(ARG_0);
-  char *file = *(char **)(ARG_0);
+  char *file = copy_in_string((char *)args[0]);
+  if (file == NULL)
+  {
+    f->eax = -1;
+    return;
+  }
 
-  lock_acquire(&file_lock);
   struct file *ff = filesys_open(file);
+  palloc_free_page(file);
   if (ff == NULL)
   {
-    lock_release(&file_lock);
     f->eax = -1;
     return;
   }
@@ -223,234 +266,440 @@ syscall_open(struct intr_frame *f)
     struct File_info *info = malloc(sizeof(struct File_info));
     if (info == NULL)
     {
-      lock_release(&file_lock);
-      unpin_frame(ARG_0);
+      file_close(ff);
       terminate_thread(STATUS_FAIL);
     }
     info->fd = thread_current()->fd;
     info->file = ff;
+    info->dir = NULL;
+    struct inode *inode = file_get_inode(ff);
+    if (inode_is_dir(inode) && (info->dir = dir_open(inode_reopen(inode))) == NULL)
+    {
+      file_close(ff);
+      free(info);
+      f->eax = -1;
+      return;
+    }
     hash_insert(&thread_current()->file_table, &info->elem);
   }
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
   f->eax = thread_current()->fd++;
 }
 
 /* Returns the size, in bytes, of the ﬁle open as fd. */
 static void
-syscall_filesize(struct intr_frame *f)
+syscall_filesize(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  int fd = *((int *)(ARG_0));
+  int fd = (int)args[0];
 
-  lock_acquire(&file_lock);
   struct File_info *info = get_file_info(fd);
-  if (CHECK_NULL_FILE(info->file))
+  if (info == NULL)
   {
-    lock_release(&file_lock);
     terminate_thread(STATUS_FAIL);
   }
   int size = file_length(info->file);
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
   f->eax = size;
 }
 
-/* Reads size bytes from the ﬁle open as fd into buﬀer. */
+/* Reads size bytes from the ﬁle open as fd into buﬀer, one user page at
+   a time. A user page must not fault while a file system lock is held, as
+   loading it may need the file system. So a page that takes at least
+   DIRECT_IO_MIN bytes is faulted in, pinned and filled directly through
+   its kernel address, and smaller pieces go through a small buffer on the
+   stack, whose copy to user memory may then fault freely. */
 static void
-syscall_read(struct intr_frame *f)
+syscall_read(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  check_validation(ARG_1);
-  check_validation(ARG_2);
-  check_validation_rw(*(void **)(ARG_1), *((unsigned *)(ARG_2)));
-  int fd = *((int *)(ARG_0));
-  void *buffer = *(void **)(ARG_1);
-  unsigned size = *((unsigned *)(ARG_2));
+  int fd = (int)args[0];
+  uint8_t *buffer = (uint8_t *)args[1];
+  unsigned size = (unsigned)args[2];
+  if (!is_user_range(buffer, size))
+  {
+    terminate_thread(STATUS_FAIL);
+  }
 
   /* Reads size bytes from the open file fd into buffer */
-  // pin_frame_file(buffer, size);
   if (fd == 0)
   {
     /* Standard input reading */
     for (unsigned i = 0; i < size; i++)
     {
-      ((char *)buffer)[i] = input_getc(); // It is a char!
+      if (!put_user(buffer + i, input_getc()))
+      {
+        terminate_thread(STATUS_FAIL);
+      }
     }
     f->eax = size;
     return;
   }
-  lock_acquire(&file_lock);
   struct File_info *info = get_file_info(fd);
-  if (CHECK_NULL_FILE(info->file))
+  if (info == NULL)
   {
-    lock_release(&file_lock);
-    unpin_frame(ARG_0);
-    unpin_frame(ARG_1);
-    unpin_frame(ARG_2);
-    unpin_frame_file(buffer, size);
     terminate_thread(STATUS_FAIL);
   }
-  int read_size = file_read(info->file, buffer, size);
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
-  unpin_frame(ARG_1);
-  unpin_frame(ARG_2);
-  unpin_frame_file(buffer, size);
+  if (info->dir != NULL)
+  {
+    /* directories are only read with readdir */
+    f->eax = -1;
+    return;
+  }
+  uint8_t bounce[DIRECT_IO_MIN];
+  unsigned read_size = 0;
+  while (read_size < size)
+  {
+    uint8_t *upos = buffer + read_size;
+    unsigned page_left = PGSIZE - pg_ofs(upos);
+    unsigned chunk_size = size - read_size < page_left ? size - read_size : page_left;
+    uint8_t *kpage = NULL;
+    if (chunk_size >= DIRECT_IO_MIN && !pin_user_page(upos, true, &kpage))
+    {
+      terminate_thread(STATUS_FAIL);
+    }
+    unsigned chunk_read;
+    if (kpage != NULL)
+    {
+      chunk_read = file_read(info->file, kpage + pg_ofs(upos), chunk_size);
+      unpin_user_page(upos, true);
+    }
+    else
+    {
+      if (chunk_size > DIRECT_IO_MIN)
+      {
+        chunk_size = DIRECT_IO_MIN;
+      }
+      chunk_read = file_read(info->file, bounce, chunk_size);
+      if (!copy_to_user(upos, bounce, chunk_read))
+      {
+        terminate_thread(STATUS_FAIL);
+      }
+    }
+    read_size += chunk_read;
+    if (chunk_read < chunk_size)
+    {
+      break;
+    }
+  }
   f->eax = read_size;
 }
 
-/* Writes size bytes from buﬀer to the open ﬁle fd. */
+/* Writes size bytes from buﬀer to the open ﬁle fd, one user page at a
+   time like read: from the pinned page itself, or for small pieces
+   through a buffer on the stack. */
 static void
-syscall_write(struct intr_frame *f)
+syscall_write(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  check_validation(ARG_1);
-  check_validation(ARG_2);
-  check_validation_rw(*(void **)(ARG_1), *((unsigned *)(ARG_2)));
-  int fd = *((int *)(ARG_0));
-  void *buffer = *(void **)(ARG_1);
-  unsigned size = *((unsigned *)(ARG_2));
+  int fd = (int)args[0];
+  const uint8_t *buffer = (const uint8_t *)args[1];
+  unsigned size = (unsigned)args[2];
+  if (!is_user_range(buffer, size))
+  {
+    terminate_thread(STATUS_FAIL);
+  }
 
   /* Writes size bytes from buffer to the open file fd */
-  // pin_frame_file(buffer, size);
-  if (fd == 1)
+  struct File_info *info = NULL;
+  if (fd != 1)
   {
-    /* Standard output writing */
-    putbuf(buffer, size);
-    f->eax = size;
-    return;
+    info = get_file_info(fd);
+    if (info == NULL)
+    {
+      terminate_thread(STATUS_FAIL);
+    }
+    if (info->dir != NULL)
+    {
+      f->eax = -1;
+      return;
+    }
   }
-  lock_acquire(&file_lock);
-  struct File_info *info = get_file_info(fd);
-  if (CHECK_NULL_FILE(info->file))
+  uint8_t bounce[DIRECT_IO_MIN];
+  unsigned write_size = 0;
+  while (write_size < size)
   {
-    lock_release(&file_lock);
-    unpin_frame(ARG_0);
-    unpin_frame(ARG_1);
-    unpin_frame(ARG_2);
-    unpin_frame_file(buffer, size);
-    terminate_thread(STATUS_FAIL);
+    uint8_t *upos = (uint8_t *)buffer + write_size;
+    unsigned page_left = PGSIZE - pg_ofs(upos);
+    unsigned chunk_size = size - write_size < page_left ? size - write_size : page_left;
+    uint8_t *kpage = NULL;
+    if (chunk_size >= DIRECT_IO_MIN && !pin_user_page(upos, false, &kpage))
+    {
+      terminate_thread(STATUS_FAIL);
+    }
+    const uint8_t *kbuffer;
+    if (kpage != NULL)
+    {
+      kbuffer = kpage + pg_ofs(upos);
+    }
+    else
+    {
+      if (chunk_size > DIRECT_IO_MIN)
+      {
+        chunk_size = DIRECT_IO_MIN;
+      }
+      if (!copy_from_user(bounce, upos, chunk_size))
+      {
+        terminate_thread(STATUS_FAIL);
+      }
+      kbuffer = bounce;
+    }
+    unsigned chunk_written;
+    if (fd == 1)
+    {
+      /* Standard output writing */
+      putbuf((const char *)kbuffer, chunk_size);
+      chunk_written = chunk_size;
+    }
+    else
+    {
+      chunk_written = file_write(info->file, kbuffer, chunk_size);
+    }
+    if (kpage != NULL)
+    {
+      unpin_user_page(upos, false);
+    }
+    write_size += chunk_written;
+    if (chunk_written < chunk_size)
+    {
+      break;
+    }
   }
-  int write_size = file_write(info->file, buffer, size);
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
-  unpin_frame(ARG_1);
-  unpin_frame(ARG_2);
-  unpin_frame_file(buffer, size);
   f->eax = write_size;
 }
 
 /* Changes the next byte to be read or written in open ﬁle fd to position,
    expressed in bytes from the beginning of the ﬁle. */
 static void
-syscall_seek(struct intr_frame *f)
+syscall_seek(struct intr_frame *f UNUSED, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  check_validation(ARG_1);
-  int fd = *((int *)(ARG_0));
-  unsigned position = *((unsigned *)(ARG_1));
+  int fd = (int)args[0];
+  unsigned position = (unsigned)args[1];
 
-  lock_acquire(&file_lock);
   struct File_info *info = get_file_info(fd);
   if (info)
   {
     file_seek(info->file, position);
   }
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
-  unpin_frame(ARG_1);
 }
 
 /* Returns the position of the next byte to be read or written in open ﬁle fd,
    expressed in bytes from the beginning of the ﬁle. */
 static void
-syscall_tell(struct intr_frame *f)
+syscall_tell(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  int fd = *((int *)(ARG_0));
+  int fd = (int)args[0];
 
-  lock_acquire(&file_lock);
   struct File_info *info = get_file_info(fd);
-  if (info)
-  {
-    file_tell(info->file);
-  }
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
+  unsigned position = info != NULL ? file_tell(info->file) : 0;
+  f->eax = position;
 }
 
 /* Closes ﬁle descriptor fd. Exiting or terminating a process implicitly closes
    all its open ﬁle descriptors, as if by calling this function for each one. */
 static void
-syscall_close(struct intr_frame *f)
+syscall_close(struct intr_frame *f UNUSED, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  int fd = *((int *)(ARG_0));
+  int fd = (int)args[0];
 
-  lock_acquire(&file_lock);
   struct File_info *info = get_file_info(fd);
   if (info)
   {
     file_close(info->file);
+    dir_close(info->dir);
     hash_delete(&thread_current()->file_table, &info->elem);
     free(info);
   }
-  lock_release(&file_lock);
-  unpin_frame(ARG_0);
 }
 
-static void syscall_mmap(struct intr_frame *f)
+static void syscall_mmap(struct intr_frame *f, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  check_validation(ARG_1);
-  int fd = *(int *)(ARG_0);
-  uint32_t address = *(uint32_t *)(ARG_1);
-  lock_acquire(&file_lock);
+  int fd = (int)args[0];
+  uint32_t address = args[1];
   struct File_info *find = get_file_info(fd);
-  if (find == NULL)
+  if (find == NULL || find->dir != NULL)
   {
     f->eax = -1;
     return;
   }
 
   struct file *file = file_reopen(find->file);
-  lock_release(&file_lock);
   struct mmap_elem *adding = malloc(sizeof(struct mmap_elem));
   if (is_stack_address((void *)address, f->esp) || !load_mmap(file, address, adding))
   {
+    file_close(file);
     free(adding);
     f->eax = -1;
-    unpin_frame(ARG_0);
-    unpin_frame(ARG_1);
     return;
   }
 
   f->eax = thread_current()->map_int;
   adding->file = file;
   adding->mapid = thread_current()->map_int++;
-  adding->page_address = address;
   hash_insert(&thread_current()->mmap_hash, &adding->elem);
-  unpin_frame(ARG_0);
-  unpin_frame(ARG_1);
 }
 
-static void syscall_unmmap(struct intr_frame *f)
+static void syscall_unmmap(struct intr_frame *f UNUSED, const uint32_t *args)
 {
-  check_validation(ARG_0);
-  struct mmap_elem temp;
-  temp.mapid = *(int *)(ARG_0);
-  struct hash_elem *find = hash_find(&thread_current()->mmap_hash, &temp.elem);
-  if (find == NULL)
+  struct mmap_elem *found = get_mmap_elem((int)args[0]);
+  if (found == NULL)
   {
-    unpin_frame(ARG_0);
     PANIC("mapid not found");
   }
-  hash_delete(&thread_current()->mmap_hash, find);
+  hash_delete(&thread_current()->mmap_hash, &found->elem);
+  lock_acquire(&page_lock);
+  munmapHelper(&found->elem, NULL);
+  lock_release(&page_lock);
+}
+
+/* Writes the dirty pages of mapping mapid back to its file. With MS_ASYNC
+   the write back is handed to the msync thread and the call returns at
+   once. Returns 0 on success, -1 for a bad mapid or flags. */
+static void syscall_msync(struct intr_frame *f, const uint32_t *args)
+{
+  int mapid = (int)args[0];
+  int flags = (int)args[1];
+
+  struct mmap_elem *found = get_mmap_elem(mapid);
+  if (found == NULL || (flags != MS_SYNC && flags != MS_ASYNC))
+  {
+    f->eax = -1;
+    return;
+  }
+  lock_acquire(&page_lock);
+  if (flags == MS_ASYNC)
+  {
+    region_sync_async(found->region, thread_current()->pagedir);
+  }
+  else
+  {
+    region_write_back(found->region, thread_current()->pagedir);
+  }
+  lock_release(&page_lock);
+  f->eax = 0;
+}
+
+/* Gives the kernel a hint on how mapping mapid will be used, see MADV_*.
+   Returns 0 on success, -1 for a bad mapid or advice. */
+static void syscall_madvise(struct intr_frame *f, const uint32_t *args)
+{
+  int mapid = (int)args[0];
+  int advice = (int)args[1];
+
+  struct mmap_elem *found = get_mmap_elem(mapid);
+  if (found == NULL)
+  {
+    f->eax = -1;
+    return;
+  }
   lock_acquire(&page_lock);
-  munmapHelper(find, NULL);
+  bool success = region_advise(found->region, advice);
   lock_release(&page_lock);
-  unpin_frame(ARG_0);
+  f->eax = success ? 0 : -1;
+}
+
+/* Changes the current working directory of the process to dir, which may
+   be relative or absolute. Returns true if successful, false on failure. */
+static void syscall_chdir(struct intr_frame *f, const uint32_t *args)
+{
+  char *dir = copy_in_string((char *)args[0]);
+  if (dir == NULL)
+  {
+    f->eax = false;
+    return;
+  }
+
+  bool success = filesys_chdir(dir);
+  palloc_free_page(dir);
+  f->eax = success;
+}
+
+/* Creates the directory named dir, which may be relative or absolute.
+   Returns true if successful, false on failure. */
+static void syscall_mkdir(struct intr_frame *f, const uint32_t *args)
+{
+  char *dir = copy_in_string((char *)args[0]);
+  if (dir == NULL)
+  {
+    f->eax = false;
+    return;
+  }
+
+  bool success = filesys_mkdir(dir);
+  palloc_free_page(dir);
+  f->eax = success;
+}
+
+/* Reads a directory entry from fd, which must represent a directory, and
+   stores the null terminated file name in name. Returns false if no
+   entries are left or fd is not a directory. */
+static void syscall_readdir(struct intr_frame *f, const uint32_t *args)
+{
+  int fd = (int)args[0];
+  char *name = (char *)args[1];
+  char kname[NAME_MAX + 1];
+
+  struct File_info *info = get_file_info(fd);
+  bool success = info != NULL && info->dir != NULL && dir_readdir(info->dir, kname);
+  if (success && !copy_to_user(name, kname, strlen(kname) + 1))
+  {
+    terminate_thread(STATUS_FAIL);
+  }
+  f->eax = success;
+}
+
+/* Returns true if fd represents a directory, false if it represents an
+   ordinary file. */
+static void syscall_isdir(struct intr_frame *f, const uint32_t *args)
+{
+  int fd = (int)args[0];
+
+  struct File_info *info = get_file_info(fd);
+  bool is_dir = info != NULL && info->dir != NULL;
+  f->eax = is_dir;
+}
+
+/* Returns the inode number of the inode associated with fd, which may
+   represent an ordinary file or a directory. */
+static void syscall_inumber(struct intr_frame *f, const uint32_t *args)
+{
+  int fd = (int)args[0];
+
+  struct File_info *info = get_file_info(fd);
+  int inumber = info != NULL ? (int)inode_get_inumber(file_get_inode(info->file)) : -1;
+  f->eax = inumber;
+}
+
+/* Copies the I/O statistics of the block device named device, such as
+   "hda1", or of the one in the role named device, such as "swap", to
+   stats. Returns false if there is no such device. */
+static void syscall_blockstats(struct intr_frame *f, const uint32_t *args)
+{
+  char *device = copy_in_string((char *)args[0]);
+  struct block_stats *stats = (struct block_stats *)args[1];
+  struct block_stats kstats;
+  if (device == NULL)
+  {
+    f->eax = false;
+    return;
+  }
+
+  struct block *block = block_get_by_name(device);
+  for (enum block_type role = 0; block == NULL && role < BLOCK_ROLE_CNT; role++)
+  {
+    if (!strcmp(device, block_type_name(role)))
+    {
+      block = block_get_role(role);
+    }
+  }
+  palloc_free_page(device);
+  if (block == NULL)
+  {
+    f->eax = false;
+    return;
+  }
+
+  block_get_stats(block, &kstats);
+  if (!copy_to_user(stats, &kstats, sizeof kstats))
+  {
+    terminate_thread(STATUS_FAIL);
+  }
+  f->eax = true;
 }
 
 /* get file info from fd */
@@ -468,120 +717,168 @@ get_file_info(int fd)
   return NULL;
 }
 
-/* Function used for checking validation for the user virtual address is valid
-   and check whether there is page, if there is page then pin the frame. If
-   the address given is invalid, call syscall_exit to terminate the process. */
-static void check_validation(void *vaddr)
+/* get mmap element from mapid */
+static struct mmap_elem *
+get_mmap_elem(int mapid)
 {
-  if (vaddr == NULL || !is_user_vaddr(vaddr))
-  {
-    terminate_thread(STATUS_FAIL);
-  }
-  else
+  struct mmap_elem key;
+  key.mapid = mapid;
+  struct hash_elem *e = hash_find(&thread_current()->mmap_hash, &key.elem);
+  if (e != NULL)
   {
-    page_elem page_elem = page_lookup((uint32_t)pg_round_down(vaddr));
-    if (page_elem == NULL)
-    {
-      terminate_thread(STATUS_FAIL);
-    }
-    pin_frame(vaddr);
+    return hash_entry(e, struct mmap_elem, elem);
   }
+  return NULL;
 }
 
-/* special case for string that need to check whether content is null */
-static void check_validation_str(char **vaddr)
+/* Copies the system call number at ESP and the argument words it takes
+   into BLOCK, checking the whole block once. When the largest block lies
+   in one page that is already mapped it is copied directly, otherwise the
+   number and the arguments go through copy_from_user. Returns false for
+   a bad stack pointer or an unknown system call number. */
+static bool
+fetch_syscall_args(const void *esp, uint32_t *block)
 {
-  if (*vaddr == NULL)
+  size_t block_size = (1 + SYSCALL_MAX_ARGS) * sizeof(uint32_t);
+  bool fast = is_user_range(esp, block_size) &&
+              pg_round_down(esp) == pg_round_down(esp + block_size - 1) &&
+              pagedir_get_page(thread_current()->pagedir, esp) != NULL;
+  if (fast)
   {
-    terminate_thread(STATUS_FAIL);
+    /* words past the arguments of this call are read but never used */
+    memcpy(block, esp, block_size);
   }
-  check_validation(vaddr);
+  else if (!copy_from_user(block, esp, sizeof(uint32_t)))
+  {
+    return false;
+  }
+  uint32_t syscall_num = block[0];
+  if (syscall_num >= sizeof(syscall_table) / sizeof(syscall_table[0]) ||
+      syscall_table[syscall_num].handler == NULL)
+  {
+    return false;
+  }
+  return fast || copy_from_user(block + 1, esp + sizeof(uint32_t),
+                                syscall_table[syscall_num].argc * sizeof(uint32_t));
 }
 
-/* Function used for making sure that the buffer stored the file is valid by
-   using for loop. It will also pin all the file page and load it into frame */
-static void check_validation_rw(void *buffer, unsigned size)
+/* Reads a byte at user virtual address UADDR, which must be below
+   PHYS_BASE. Returns the byte value if successful, -1 if a segfault
+   occurred: the page fault handler then resumes at label 1 with -1 in
+   eax. */
+static int
+get_user(const uint8_t *uaddr)
 {
-  /* address of the start of buffer */
-  uint32_t local = (uint32_t)pg_round_down(buffer);
-  unsigned buffer_length = (uint32_t)buffer + size;
-  for (; local < buffer_length; local += PGSIZE)
-  {
-    if (local < USER_BOTTOM || !is_user_vaddr((const void *)local))
-    {
-      terminate_thread(STATUS_FAIL);
-    }
-    check_validation((void *)local);
-  }
+  int result;
+  asm("movl $1f, %0; movzbl %1, %0; 1:" : "=&a"(result) : "m"(*uaddr));
+  return result;
 }
 
-/* unmap all the file in frame */
-static void unpin_frame_file(void *uaddr, int size)
+/* Writes BYTE to user address UDST, which must be below PHYS_BASE.
+   Returns true if successful, false if a segfault occurred. */
+static bool
+put_user(uint8_t *udst, uint8_t byte)
 {
-  lock_acquire(&page_lock);
+  int error_code;
+  asm("movl $1f, %0; movb %b2, %1; 1:" : "=&a"(error_code), "=m"(*udst) : "q"(byte));
+  return error_code != -1;
+}
+
+/* check that SIZE bytes at UADDR are all below PHYS_BASE */
+static bool
+is_user_range(const void *uaddr, size_t size)
+{
+  uint32_t start = (uint32_t)uaddr;
+  return size == 0 || (uaddr != NULL && start + size > start &&
+                       start + size <= (uint32_t)PHYS_BASE);
+}
 
-  uint32_t local = (uint32_t)pg_round_down(uaddr);
-  uint32_t buffer_length = (uint32_t)uaddr + size;
-  for (; local < buffer_length; local += PGSIZE)
+/* Copies SIZE bytes from user address USRC into KDST. Each user page is
+   first touched with get_user so a bad address is reported instead of
+   crashing the kernel, the memcpy then faults the page in as usual.
+   Returns false if the range is not valid user memory. Must not be
+   called with page_lock or a file system lock held. */
+static bool
+copy_from_user(void *kdst, const void *usrc, size_t size)
+{
+  if (!is_user_range(usrc, size))
   {
-    if (!page_set_pin((uint32_t)local, false))
+    return false;
+  }
+  while (size > 0)
+  {
+    size_t chunk_size = PGSIZE - pg_ofs(usrc);
+    if (chunk_size > size)
     {
-      lock_release(&page_lock);
-      terminate_thread(STATUS_FAIL);
+      chunk_size = size;
     }
+    if (get_user(usrc) == -1)
+    {
+      return false;
+    }
+    memcpy(kdst, usrc, chunk_size);
+    kdst += chunk_size;
+    usrc += chunk_size;
+    size -= chunk_size;
   }
-
-  lock_release(&page_lock);
+  return true;
 }
 
-/* set pin and move item into frame if not in frame */
-static void pin_frame(void *uaddr)
+/* Copies SIZE bytes from KSRC to user address UDST, the counterpart of
+   copy_from_user. Returns false for a bad or read only user page. */
+static bool
+copy_to_user(void *udst, const void *ksrc, size_t size)
 {
-  lock_acquire(&page_lock);
-  /* not need to exists if failed */
-  if (page_lookup((uint32_t)pg_round_down(uaddr)) == NULL)
+  if (!is_user_range(udst, size))
   {
-    lock_release(&page_lock);
-    return;
+    return false;
   }
-  page_set_pin((uint32_t)pg_round_down(uaddr), true);
-  /* load into frame, doing same thing as page fault*/
-  page_elem page = page_lookup((uint32_t)pg_round_down(uaddr));
-  if (pagedir_get_page(thread_current()->pagedir, (void *)page->page_address) == NULL)
+  while (size > 0)
   {
-    if (page->page_status == IN_SWAP)
+    size_t chunk_size = PGSIZE - pg_ofs(udst);
+    if (chunk_size > size)
     {
-      void *kpage = swap_back_page(page->page_address);
-      if (!install_page((void *)page->page_address, (void *)kpage, page->writable))
-      {
-        PANIC("install page failed\n");
-      }
-      pagedir_set_dirty(thread_current()->pagedir, (void *)page->page_address, page->dirty);
+      chunk_size = size;
     }
-    else if (page->page_status == IN_FILE || page->page_status == IS_MMAP)
+    if (!put_user(udst, *(const uint8_t *)ksrc))
     {
-      load_page(page->lazy_file, page);
-    }
-    else
-    {
-      PANIC("pin_frame: page status is wrong\n");
+      return false;
     }
+    memcpy(udst, ksrc, chunk_size);
+    udst += chunk_size;
+    ksrc += chunk_size;
+    size -= chunk_size;
   }
-  lock_release(&page_lock);
+  return true;
 }
 
-/* unpin the single page */
-static void unpin_frame(void *uaddr)
+/* Copies the string at user address USTR into a new kernel page which the
+   caller frees with palloc_free_page. Terminates the process if USTR is
+   a bad pointer, returns NULL if the string does not fit in a page. */
+static char *
+copy_in_string(const char *ustr)
 {
-  lock_acquire(&page_lock);
-  /* not need to exists if failed */
-  if (page_lookup((uint32_t)pg_round_down(uaddr)) == NULL)
+  char *kstr = palloc_get_page(0);
+  if (kstr == NULL)
   {
-    lock_release(&page_lock);
-    return;
+    terminate_thread(STATUS_FAIL);
   }
-  page_set_pin((uint32_t)pg_round_down(uaddr), false);
-  lock_release(&page_lock);
+  for (size_t i = 0; i < PGSIZE; i++)
+  {
+    int c = is_user_vaddr(ustr + i) ? get_user((const uint8_t *)ustr + i) : -1;
+    if (c == -1)
+    {
+      palloc_free_page(kstr);
+      terminate_thread(STATUS_FAIL);
+    }
+    kstr[i] = c;
+    if (c == '\0')
+    {
+      return kstr;
+    }
+  }
+  palloc_free_page(kstr);
+  return NULL;
 }
 
 /* doing similar thing as syscall exit but receive status as a argument */
@@ -589,11 +886,6 @@ void terminate_thread(int status)
 {
   struct thread *cur = thread_current();
   printf("%s: exit(%" PRId32 ")\n", cur->name, status);
-  /* ensure the file lock has been released */
-  if (file_lock.holder == cur)
-  {
-    lock_release(&file_lock);
-  }
   if (cur->parent_status == false && cur->child_status_pointer != NULL)
   {
     *(cur->child_status_pointer) = true;
@@ -604,88 +896,84 @@ void terminate_thread(int status)
   NOT_REACHED();
 }
 
+/* record the whole mapping as one region, pages are created lazily by the
+   page fault handler so this does not depend on the length of the file */
 static bool
 load_mmap(struct file *file, uint32_t upage, struct mmap_elem *mmap_elem)
 {
-  lock_acquire(&file_lock);
   uint32_t length = file_length(file);
-  lock_release(&file_lock);
   if (length == 0 || pg_ofs((void *)upage) != 0 || (void *)upage == NULL)
   {
     return false;
   }
-  uint32_t read_bytes = length;
-  uint32_t zero_bytes = (PGSIZE - (length % PGSIZE)) % PGSIZE;
-  uint32_t oldUpage = upage;
-  off_t ofs = 0;
-  int page_num = 0;
-  while (read_bytes > 0)
+  /* the mapping has to stay below the shared page and the stack */
+  uint32_t end = upage + ROUND_UP(length, PGSIZE);
+  if (end < upage || end > VDSO_BASE)
   {
-    size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-
-    lock_acquire(&page_lock);
-    if (page_lookup(oldUpage) != NULL)
-    {
-      lock_release(&page_lock);
-      return false;
-    }
-    lock_release(&page_lock);
-
-    ofs += page_read_bytes;
-    read_bytes -= page_read_bytes;
-    oldUpage += PGSIZE;
-    page_num++;
+    return false;
   }
-  mmap_elem->page_num = page_num;
-  for (int i = 0; i < page_num; i++)
+  lock_acquire(&page_lock);
+  if (region_overlaps(upage, end))
   {
-    lock_acquire(&page_lock);
-    struct page_elem *page = page_table_adding(upage + i * PGSIZE, (uint32_t)NULL, IS_MMAP);
     lock_release(&page_lock);
-    page->lazy_file = malloc(sizeof(struct lazy_file));
-    page->lazy_file->file = file;
-    page->lazy_file->offset = i * PGSIZE;
-    if (i == page_num - 1)
-    {
-      page->lazy_file->read_bytes = PGSIZE - zero_bytes;
-      page->lazy_file->zero_bytes = zero_bytes;
-    }
-    else
-    {
-      page->lazy_file->read_bytes = PGSIZE;
-      page->lazy_file->zero_bytes = 0;
-    }
-    page->writable = true;
-    page->swapped_id = -1;
+    return false;
   }
-
-  return true;
+  mmap_elem->region = region_add(upage, length, file, 0, length, true, REGION_MMAP);
+  lock_release(&page_lock);
+  return mmap_elem->region != NULL;
 }
 
-/* a helper function for munmap */
+/* a helper function for munmap, dirty pages are written back and only the
+   pages touched since mmap are visited for teardown */
 void munmapHelper(struct hash_elem *found_elem, void *aux UNUSED)
 {
   struct mmap_elem *found = hash_entry(found_elem, struct mmap_elem, elem);
-  int n = found->page_num;
-  for (int i = 0; i < n; i++)
-  {
-    uint32_t page = found->page_address + i * PGSIZE;
-    if (pagedir_get_page(thread_current()->pagedir, (void *)page) != NULL)
-    {
-      // only write back if it is dirty
-      if (pagedir_is_dirty(thread_current()->pagedir, (void *)page))
-      {
-        ASSERT((void *)page_lookup(page)->kernel_address != NULL);
-        lock_acquire(&file_lock);
-        file_write_at(found->file, (void *)page_lookup(page)->kernel_address, PGSIZE, page_lookup(page)->lazy_file->offset);
-        lock_release(&file_lock);
-      }
-    }
-    pagedir_clear_page(thread_current()->pagedir, (void *)page);
-    page_clear(page);
-  }
-  lock_acquire(&file_lock);
+  region_write_back(found->region, thread_current()->pagedir);
+  region_drop_pages(found->region);
+  region_remove(found->region);
   file_close(found->file);
-  lock_release(&file_lock);
   free(found);
-}
\ No newline at end of file
+}
+
+/* Brings the user page holding UADDR into memory, writable if WRITE is
+   true, and pins its frame so it is not evicted while the kernel uses it.
+   Stores the kernel address of the frame in *KPAGEP, or NULL if the page
+   cannot be pinned and a bounce buffer must be used instead. Returns false
+   if UADDR is not user memory accessible that way, leaving the caller to
+   free what it holds before terminating the process. */
+static bool
+pin_user_page(uint8_t *uaddr, bool write, uint8_t **kpagep)
+{
+  /* writing the byte back faults the page in for writing */
+  int byte = get_user(uaddr);
+  if (byte == -1 || (write && !put_user(uaddr, byte)))
+  {
+    return false;
+  }
+  void *upage = pg_round_down(uaddr);
+  lock_acquire(&page_lock);
+  uint8_t *kpage = pagedir_get_page(thread_current()->pagedir, upage);
+  if (kpage != NULL && !page_set_pin((uint32_t)upage, true))
+  {
+    kpage = NULL;
+  }
+  lock_release(&page_lock);
+  *kpagep = kpage;
+  return true;
+}
+
+/* Unpins the user page holding UADDR after pin_user_page. If WRITTEN,
+   the page was written through its kernel address, so it is marked dirty
+   here for the write back of mapped files and for swapping. */
+static void
+unpin_user_page(uint8_t *uaddr, bool written)
+{
+  void *upage = pg_round_down(uaddr);
+  lock_acquire(&page_lock);
+  if (written)
+  {
+    pagedir_set_dirty(thread_current()->pagedir, upage, true);
+  }
+  page_set_pin((uint32_t)upage, false);
+  lock_release(&page_lock);
+}
@@ -12,16 +12,14 @@ typedef int pid_t;
 #define PID_ERROR ((pid_t)-1) /* Error value for pid_t. */
 
 /* definition for arguments */
-#define ESP f->esp
-#define ARG_0 f->esp + 4
-#define ARG_1 f->esp + 8
-#define ARG_2 f->esp + 12
+#define SYSCALL_MAX_ARGS 3 /* most argument words taken by a system call */
 
 /* File descriptor which store the file and the file descriptor number */
 struct File_info
 {
   int fd;
   struct file *file;
+  struct dir *dir; /* position for readdir if FILE is a directory, else NULL */
   struct hash_elem elem;
 };
 
@@ -29,8 +27,7 @@ struct mmap_elem
 {
   int mapid;
   struct hash_elem elem;
-  uint32_t page_num;
-  uint32_t page_address;
+  struct region *region; /* pages covered by this mapping */
   struct file *file;
 };
 
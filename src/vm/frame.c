@@ -132,7 +132,7 @@ void frame_swap()
     lock_acquire(&page_lock);
     locked_by_own = true;
   }
-  while (frame_elem->ppage->is_pin ||
+  while (frame_elem->ppage->pin_cnt > 0 ||
          pagedir_is_accessed(get_pd(frame_pointer),
                              (void *)frame_elem->ppage->page_address) == true)
   {
@@ -145,10 +145,9 @@ void frame_swap()
   {
     if (pagedir_is_dirty(frame_elem->ppage->pd, (void *)frame_elem->ppage->page_address))
     {
-      lock_acquire(&file_lock);
       file_write_at(frame_elem->ppage->lazy_file->file,
-                    (void *)frame_elem->frame_addr, PGSIZE, frame_elem->ppage->lazy_file->offset);
-      lock_release(&file_lock);
+                    (void *)frame_elem->frame_addr, frame_elem->ppage->lazy_file->read_bytes,
+                    frame_elem->ppage->lazy_file->offset);
     }
   }
   else
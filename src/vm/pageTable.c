@@ -30,7 +30,9 @@ page_elem page_table_adding(const uint32_t page_address, const uint32_t kernel_a
     adding->kernel_address = kernel_address;
     adding->page_status = status;
     adding->swapped_id = -1;
-    adding->is_pin = false;
+    adding->pin_cnt = 0;
+    adding->lazy_file = NULL;
+    adding->region = NULL;
     hash_insert(&thread_current()->supplemental_page_table, &adding->elem);
     return adding;
 }
@@ -48,22 +50,22 @@ void page_free_action(struct hash_elem *element, void *aux UNUSED)
         swap_drop(removing->swapped_id);
         break;
     case IN_FILE:
-        if (removing->writable)
-        {
-            free(removing->lazy_file);
-        }
-        else
+        if (!removing->writable)
         {
             pagedir_clear_page(removing->pd, (void *)removing->page_address);
         }
         break;
     case IS_MMAP:
-        free(removing->lazy_file);
         if ((void *)removing->kernel_address != NULL)
         {
             frame_free(removing->kernel_address);
         }
     }
+    if (removing->region != NULL)
+    {
+        list_remove(&removing->region_elem);
+    }
+    free(removing->lazy_file);
     free(removing);
 };
 
@@ -103,6 +105,8 @@ page_lookup(const uint32_t page_address)
     return get_page_elem(find);
 }
 
+/* pin or unpin PAGE_ADDRESS of the current process, pins nest so the
+   kernel and the msync thread can hold the same page at once */
 bool page_set_pin(uint32_t page_address, bool pin)
 {
     page_elem find = page_lookup(page_address);
@@ -110,6 +114,6 @@ bool page_set_pin(uint32_t page_address, bool pin)
     {
         return false;
     }
-    find->is_pin = pin;
+    find->pin_cnt += pin ? 1 : -1;
     return true;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 
 #define get_page_elem(ELEM) hash_entry(ELEM, struct page_elem, elem)
 
+struct region;
+
 unsigned page_hash_func(const struct hash_elem *element, void *aux);
 bool page_less_func(const struct hash_elem *a, const struct hash_elem *b, void *aux);
 
@@ -40,7 +42,9 @@ typedef struct page_elem
    size_t swapped_id;
    bool writable;
    bool dirty;
-   bool is_pin;
+   int pin_cnt;                  /* never evicted while above zero */
+   struct region *region;        /* region it was materialized from, or NULL */
+   struct list_elem region_elem; /* element in region's page_list */
 } *page_elem;
 
 page_elem page_table_adding(const uint32_t, const uint32_t, enum page_status);
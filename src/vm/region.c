@@ -0,0 +1,357 @@
+#include "vm/region.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/exception.h"
+#include "filesys/file.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+
+/* regions waiting for the msync thread, protected by page_lock */
+static struct list sync_queue;
+static struct semaphore sync_sema;
+/* signalled on page_lock whenever a region's write back finishes */
+static struct condition write_back_done;
+
+static bool region_less_func(const struct list_elem *a, const struct list_elem *b, void *aux);
+static size_t region_page_read_bytes(const struct region *region, uint32_t page_address);
+static void region_load(uint32_t page_address);
+static thread_func msync_thread NO_RETURN;
+
+/* start the thread doing asynchronous msync */
+void region_init(void)
+{
+    list_init(&sync_queue);
+    sema_init(&sync_sema, 0);
+    cond_init(&write_back_done);
+    thread_create("msync", PRI_DEFAULT, msync_thread, NULL);
+}
+
+static bool
+region_less_func(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
+{
+    return get_region(a)->start < get_region(b)->start;
+}
+
+/* add a region of LENGTH bytes starting at page START into the current
+   thread, READ_BYTES of it come from FILE at OFFSET and the rest is zero */
+struct region *
+region_add(uint32_t start, uint32_t length, struct file *file,
+           off_t offset, uint32_t read_bytes, bool writable,
+           enum region_type type)
+{
+    ASSERT(pg_ofs((void *)start) == 0);
+    struct region *adding = malloc(sizeof(struct region));
+    if (adding == NULL)
+    {
+        return NULL;
+    }
+    adding->start = start;
+    adding->end = start + ROUND_UP(length, PGSIZE);
+    adding->file = file;
+    adding->offset = offset;
+    adding->read_bytes = read_bytes;
+    adding->writable = writable;
+    adding->type = type;
+    adding->advice = MADV_NORMAL;
+    adding->sync_queued = false;
+    adding->writing_back = false;
+    adding->sync_pd = NULL;
+    list_init(&adding->page_list);
+    list_insert_ordered(&thread_current()->region_list, &adding->elem, region_less_func, NULL);
+    return adding;
+}
+
+/* find the region containing ADDRESS, if several segments share the page
+   the one starting last wins, as it was loaded last */
+struct region *
+region_find(const uint32_t address)
+{
+    struct list *regions = &thread_current()->region_list;
+    struct region *found = NULL;
+    struct list_elem *e;
+    for (e = list_begin(regions); e != list_end(regions); e = list_next(e))
+    {
+        struct region *region = get_region(e);
+        if (region->start > address)
+        {
+            break;
+        }
+        if (address < region->end)
+        {
+            found = region;
+        }
+    }
+    return found;
+}
+
+/* check whether any region intersects the pages [START, END) */
+bool region_overlaps(uint32_t start, uint32_t end)
+{
+    struct list *regions = &thread_current()->region_list;
+    struct list_elem *e;
+    for (e = list_begin(regions); e != list_end(regions); e = list_next(e))
+    {
+        struct region *region = get_region(e);
+        if (region->start >= end)
+        {
+            break;
+        }
+        if (region->end > start)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* create the supplemental page entry for PAGE_ADDRESS from the region it
+   belongs to. Returns NULL if no region covers it. page_lock must be held */
+page_elem
+region_materialize(const uint32_t page_address)
+{
+    struct region *region = region_find(page_address);
+    if (region == NULL)
+    {
+        return NULL;
+    }
+    struct lazy_file *lazy_file = malloc(sizeof(struct lazy_file));
+    if (lazy_file == NULL)
+    {
+        PANIC("malloc failed");
+    }
+    size_t read_bytes = region_page_read_bytes(region, page_address);
+    lazy_file->file = region->file;
+    lazy_file->offset = region->offset + (page_address - region->start);
+    lazy_file->read_bytes = read_bytes;
+    lazy_file->zero_bytes = PGSIZE - read_bytes;
+
+    page_elem page = page_table_adding(page_address, (uint32_t)NULL,
+                                       region->type == REGION_MMAP ? IS_MMAP : IN_FILE);
+    page->lazy_file = lazy_file;
+    page->writable = region->writable;
+    page->region = region;
+    list_push_back(&region->page_list, &page->region_elem);
+    return page;
+}
+
+/* number of bytes of PAGE_ADDRESS that come from the file */
+static size_t
+region_page_read_bytes(const struct region *region, uint32_t page_address)
+{
+    uint32_t page_ofs = page_address - region->start;
+    size_t read_bytes = page_ofs < region->read_bytes ? region->read_bytes - page_ofs : 0;
+    return read_bytes < PGSIZE ? read_bytes : PGSIZE;
+}
+
+/* write the dirty pages of REGION mapped in PD back to the file. Only the
+   pages materialized in the region are visited and only the bytes inside
+   the file are written. Each page is pinned and page_lock is dropped
+   while it is written, a second write back of the same region waits for
+   this one to finish. PD does not need to be the current page directory.
+   page_lock must be held */
+void region_write_back(struct region *region, uint32_t *pd)
+{
+    ASSERT(lock_held_by_current_thread(&page_lock));
+    while (region->writing_back)
+    {
+        cond_wait(&write_back_done, &page_lock);
+    }
+    region->writing_back = true;
+    /* pages materialized while the lock is dropped join the end of the
+       list, none leaves it before writing_back is cleared */
+    struct list_elem *e;
+    for (e = list_begin(&region->page_list); e != list_end(&region->page_list); e = list_next(e))
+    {
+        page_elem page = list_entry(e, struct page_elem, region_elem);
+        void *upage = (void *)page->page_address;
+        void *kpage = pagedir_get_page(pd, upage);
+        size_t read_bytes = region_page_read_bytes(region, page->page_address);
+        if (kpage == NULL || read_bytes == 0 || !pagedir_is_dirty(pd, upage))
+        {
+            continue;
+        }
+        /* clear first so a write racing with file_write_at dirties it again */
+        pagedir_set_dirty(pd, upage, false);
+        page->pin_cnt++;
+        lock_release(&page_lock);
+        file_write_at(region->file, kpage, read_bytes,
+                      region->offset + (page->page_address - region->start));
+        lock_acquire(&page_lock);
+        page->pin_cnt--;
+    }
+    region->writing_back = false;
+    cond_broadcast(&write_back_done, &page_lock);
+}
+
+/* queue REGION of page directory PD for the msync thread and return */
+void region_sync_async(struct region *region, uint32_t *pd)
+{
+    ASSERT(lock_held_by_current_thread(&page_lock));
+    if (!region->sync_queued)
+    {
+        region->sync_queued = true;
+        region->sync_pd = pd;
+        list_push_back(&sync_queue, &region->sync_elem);
+        sema_up(&sync_sema);
+    }
+}
+
+/* thread writing back regions queued by region_sync_async */
+static void
+msync_thread(void *aux UNUSED)
+{
+    for (;;)
+    {
+        sema_down(&sync_sema);
+        lock_acquire(&page_lock);
+        /* the region may have been unmapped after it was queued. One
+           being written back by its process stays queued until that is
+           done, so it cannot be freed under this thread while it waits */
+        while (!list_empty(&sync_queue))
+        {
+            struct region *region = list_entry(list_front(&sync_queue), struct region, sync_elem);
+            if (!region->writing_back)
+            {
+                list_pop_front(&sync_queue);
+                region->sync_queued = false;
+                region_write_back(region, region->sync_pd);
+                break;
+            }
+            cond_wait(&write_back_done, &page_lock);
+        }
+        lock_release(&page_lock);
+    }
+}
+
+/* remove every materialized page of REGION from the current process and
+   give their frames back, nothing is written. page_lock must be held */
+void region_drop_pages(struct region *region)
+{
+    struct thread *cur = thread_current();
+    while (!list_empty(&region->page_list))
+    {
+        page_elem page = list_entry(list_front(&region->page_list), struct page_elem, region_elem);
+        void *kpage = pagedir_get_page(cur->pagedir, (void *)page->page_address);
+        if (kpage != NULL)
+        {
+            pagedir_clear_page(cur->pagedir, (void *)page->page_address);
+        }
+        hash_delete(&cur->supplemental_page_table, &page->elem);
+        page_free_action(&page->elem, NULL);
+        if (kpage != NULL)
+        {
+            palloc_free_page(kpage);
+        }
+    }
+}
+
+/* bring PAGE_ADDRESS of the current process into a frame if it is still
+   waiting in its file. page_lock must be held */
+static void
+region_load(uint32_t page_address)
+{
+    page_elem page = page_lookup(page_address);
+    if (page == NULL)
+    {
+        page = region_materialize(page_address);
+    }
+    if (page == NULL || pagedir_get_page(thread_current()->pagedir, (void *)page_address) != NULL)
+    {
+        return;
+    }
+    if (page->page_status == IN_FILE || page->page_status == IS_MMAP)
+    {
+        load_page(page->lazy_file, page);
+    }
+}
+
+/* apply ADVICE to REGION of the current process, returns false for an
+   unknown advice. MADV_WILLNEED loads only the first WILLNEED_PAGES now,
+   the rest is read ahead on fault. page_lock must be held, it is dropped
+   between the pages loaded so other processes are not held up */
+bool region_advise(struct region *region, int advice)
+{
+    uint32_t page;
+    switch (advice)
+    {
+    case MADV_NORMAL:
+    case MADV_SEQUENTIAL:
+        break;
+    case MADV_WILLNEED:
+        for (page = region->start;
+             page < region->end && page - region->start < WILLNEED_PAGES * PGSIZE;
+             page += PGSIZE)
+        {
+            region_load(page);
+            lock_release(&page_lock);
+            lock_acquire(&page_lock);
+        }
+        break;
+    case MADV_DONTNEED:
+        region_write_back(region, thread_current()->pagedir);
+        region_drop_pages(region);
+        break;
+    default:
+        return false;
+    }
+    region->advice = advice;
+    return true;
+}
+
+/* called after PAGE was faulted in. For a region read sequentially or
+   advised MADV_WILLNEED load the next pages too, for one read sequentially
+   also make the page behind the next eviction victim.
+   page_lock must be held */
+void region_read_ahead(page_elem page)
+{
+    struct region *region = page->region;
+    if (region == NULL
+        || (region->advice != MADV_SEQUENTIAL && region->advice != MADV_WILLNEED))
+    {
+        return;
+    }
+    uint32_t *pd = thread_current()->pagedir;
+    uint32_t behind = page->page_address - PGSIZE;
+    if (region->advice == MADV_SEQUENTIAL && behind >= region->start
+        && pagedir_get_page(pd, (void *)behind) != NULL)
+    {
+        pagedir_set_accessed(pd, (void *)behind, false);
+    }
+    for (int i = 1; i <= READ_AHEAD_PAGES; i++)
+    {
+        uint32_t ahead = page->page_address + i * PGSIZE;
+        if (ahead >= region->end)
+        {
+            break;
+        }
+        region_load(ahead);
+    }
+}
+
+/* free the region descriptor, all its pages must be cleared already */
+void region_remove(struct region *region)
+{
+    ASSERT(list_empty(&region->page_list));
+    ASSERT(!region->writing_back);
+    if (region->sync_queued)
+    {
+        list_remove(&region->sync_elem);
+    }
+    list_remove(&region->elem);
+    free(region);
+}
+
+/* free every region of the current thread, used when process exits after
+   the supplemental page table has been destroyed */
+void region_destroy_all(void)
+{
+    struct list *regions = &thread_current()->region_list;
+    while (!list_empty(regions))
+    {
+        region_remove(get_region(list_front(regions)));
+    }
+}
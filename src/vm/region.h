@@ -0,0 +1,66 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "lib/kernel/list.h"
+#include "filesys/off_t.h"
+#include <stdint.h>
+#include "vm/pageTable.h"
+
+#define get_region(ELEM) list_entry(ELEM, struct region, elem)
+
+/* flags for msync, same values as in lib/user/syscall.h */
+#define MS_SYNC 0  /* write back before returning */
+#define MS_ASYNC 1 /* queue write back to the msync thread */
+
+/* advice for madvise, same values as in lib/user/syscall.h */
+#define MADV_NORMAL 0     /* no special treatment */
+#define MADV_SEQUENTIAL 1 /* read ahead on fault, evict pages behind */
+#define MADV_WILLNEED 2   /* load the start now, read ahead on fault */
+#define MADV_DONTNEED 3   /* write back and drop the pages now */
+
+#define READ_AHEAD_PAGES 4 /* pages loaded after a fault with MADV_SEQUENTIAL */
+#define WILLNEED_PAGES 32  /* most pages loaded by MADV_WILLNEED */
+
+enum region_type
+{
+   REGION_SEGMENT, /* executable segment, pages start out IN_FILE */
+   REGION_MMAP     /* memory mapped file, pages are IS_MMAP */
+};
+
+/* A range of user pages backed by a file. Only one descriptor is kept
+   for the whole range, a page_elem is created for a page the first time
+   it is touched (see region_materialize). */
+struct region
+{
+   struct list_elem elem;   /* element in thread's region_list, sorted by start */
+   uint32_t start;          /* first user page of the region */
+   uint32_t end;            /* first user page after the region */
+   struct file *file;       /* backing file */
+   off_t offset;            /* file offset of the first page */
+   uint32_t read_bytes;     /* bytes read from file, the rest is zero filled */
+   bool writable;
+   enum region_type type;
+   struct list page_list;   /* page_elem materialized inside this region */
+   int advice;              /* last MADV_* given by madvise */
+   bool sync_queued;        /* waiting for the msync thread */
+   bool writing_back;       /* region_write_back runs with page_lock dropped */
+   uint32_t *sync_pd;       /* page directory the msync thread writes from */
+   struct list_elem sync_elem; /* element in the msync queue */
+};
+
+void region_init(void);
+struct region *region_add(uint32_t start, uint32_t length, struct file *file,
+                          off_t offset, uint32_t read_bytes, bool writable,
+                          enum region_type type);
+struct region *region_find(const uint32_t address);
+bool region_overlaps(uint32_t start, uint32_t end);
+page_elem region_materialize(const uint32_t page_address);
+void region_write_back(struct region *region, uint32_t *pd);
+void region_sync_async(struct region *region, uint32_t *pd);
+void region_drop_pages(struct region *region);
+bool region_advise(struct region *region, int advice);
+void region_read_ahead(page_elem page);
+void region_remove(struct region *region);
+void region_destroy_all(void);
+
+#endif